@@ -0,0 +1,546 @@
+#include "dartlog3.h"
+
+#include <QSaveFile>
+#include <climits>
+#include <zlib.h>
+
+#include "dartlog_encoding.h"
+#include "dartlog_input.h"
+#include "dartlog_parser.h"
+
+namespace {
+
+template <typename T>
+void put(QByteArray& out, T v) {
+    out.append((const char*) &v, sizeof(v));
+}
+
+void putString(QByteArray& out, const std::string& str) {
+    out.append(str.c_str(), (int) str.size() + 1);
+}
+
+/**
+ * @brief Bounds checked reading of the index
+ */
+class IndexReader {
+public:
+    IndexReader(const char* data, qint64 size) : p(data), end(data + size), ok(true) {
+    }
+
+    template <typename T>
+    T get() {
+        T v = T();
+        if (end - p < (qint64) sizeof(T)) {
+            ok = false;
+            return v;
+        }
+        memcpy(&v, p, sizeof(v));
+        p += sizeof(v);
+        return v;
+    }
+
+    /**
+     * @brief Reads a count of entries, which have to fit into the rest of the index
+     * @param entrySize Smallest size of an entry in bytes
+     */
+    quint32 getCount(qint64 entrySize) {
+        quint32 count = get<quint32>();
+        if ((qint64) count > (end - p) / entrySize) {
+            ok = false;
+            return 0;
+        }
+        return count;
+    }
+
+    std::string getString() {
+        const char* terminator = (const char*) memchr(p, 0, end - p);
+        if (terminator == nullptr) {
+            ok = false;
+            return "";
+        }
+        std::string str(p, terminator);
+        p = terminator + 1;
+        return str;
+    }
+
+    bool isOk() const {
+        return ok;
+    }
+
+private:
+    const char* p;
+    const char* end;
+    bool ok;
+};
+
+quint64 hashBytes(const QByteArray& data) {
+    // FNV-1a
+    quint64 hash = 14695981039346656037ull;
+    for (int i = 0; i < data.size(); i++) {
+        hash ^= (uchar) data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+}
+
+Dartlog3Reader::Dartlog3Reader(const char* data, qint64 size) : data(data), size(size) {
+}
+
+/**
+ * @brief Reads and validates the index at the end of the container
+ * @return @c true if the index was read, @c false otherwise (see errorString())
+ */
+bool Dartlog3Reader::readIndex() {
+    const qint64 headerSize = sizeof(DARTLOG3_HEADER);
+    if (size < headerSize + DARTLOG3_TRAILER_SIZE || memcmp(data, DARTLOG3_HEADER, headerSize) != 0) {
+        error = "Not a DARTLOG3 file: header missing.";
+        return false;
+    }
+
+    const char* trailer = data + size - DARTLOG3_TRAILER_SIZE;
+    if (memcmp(trailer + 16, DARTLOG3_TRAILER_MAGIC_V1, 4) == 0) {
+        error = "DARTLOG3 file of an older version: convert the log again";
+        return false;
+    }
+    if (memcmp(trailer + 16, DARTLOG3_TRAILER_MAGIC, 4) != 0) {
+        error = "DARTLOG3 index missing: file is incomplete";
+        return false;
+    }
+
+    quint64 indexOffset;
+    quint32 indexCompressedSize;
+    quint32 indexSize;
+    memcpy(&indexOffset, trailer, sizeof(indexOffset));
+    memcpy(&indexCompressedSize, trailer + 8, sizeof(indexCompressedSize));
+    memcpy(&indexSize, trailer + 12, sizeof(indexSize));
+
+    quint64 indexEnd = (quint64) (size - DARTLOG3_TRAILER_SIZE);
+    if (indexOffset > indexEnd || indexCompressedSize > indexEnd - indexOffset) {
+        error = "DARTLOG3 index out of range";
+        return false;
+    }
+
+    // zlib compresses at most about 1032:1
+    if (indexSize > (quint32) INT_MAX || indexSize > (quint64) indexCompressedSize * 1032) {
+        error = "DARTLOG3 index size invalid";
+        return false;
+    }
+
+    QByteArray indexData((int) indexSize, 0);
+    uLongf have = indexSize;
+    if (uncompress((Bytef*) indexData.data(), &have, (const Bytef*) data + indexOffset, indexCompressedSize) != Z_OK || have != indexSize) {
+        error = "Could not decompress DARTLOG3 index";
+        return false;
+    }
+
+    IndexReader reader(indexData.constData(), indexData.size());
+
+    // Counts are checked against the smallest size of their entries before allocating
+    dartlogIndex.timeBlocks.resize(reader.getCount(8 + 4 + 4 + 1 + 8 + 8 + 4));
+    for (Dartlog3Block& block : dartlogIndex.timeBlocks) {
+        block.offset = reader.get<quint64>();
+        block.size = reader.get<quint32>();
+        block.count = reader.get<quint32>();
+        block.encoding = reader.get<quint8>();
+        block.timeMin = reader.get<double>();
+        block.timeMax = reader.get<double>();
+        block.timeResets = reader.get<quint32>();
+
+        // Blocks are decoded into buffers of their count, the writer never stores more samples per block
+        if (block.count > DARTLOG3_BLOCK_SAMPLES) {
+            error = "DARTLOG3 time block too large";
+            return false;
+        }
+    }
+
+    dartlogIndex.columns.resize(reader.getCount(2 + 1 + 1 + 1 + 1 + 4));
+    for (Dartlog3Column& column : dartlogIndex.columns) {
+        column.tag.index = reader.get<quint16>();
+        column.tag.type = reader.get<quint8>();
+        column.tag.verbose = (reader.get<quint8>() & DARTLOG3_FLAG_VERBOSE) != 0;
+        column.tag.name = reader.getString();
+        column.tag.unit = reader.getString();
+
+        if (!reader.isOk())
+            break;
+
+        if (!dartlogIsValidType(column.tag.type)) {
+            error = "Wrong tag type read";
+            return false;
+        }
+
+        column.blocks.resize(reader.getCount(4 + 8 + 4 + 4 + 1));
+        for (Dartlog3Block& block : column.blocks) {
+            block.timeBlock = reader.get<quint32>();
+            block.offset = reader.get<quint64>();
+            block.size = reader.get<quint32>();
+            block.count = reader.get<quint32>();
+            block.encoding = reader.get<quint8>();
+
+            if (block.timeBlock >= dartlogIndex.timeBlocks.size() || dartlogIndex.timeBlocks[block.timeBlock].count != block.count) {
+                error = "DARTLOG3 index refers to invalid time block";
+                return false;
+            }
+        }
+    }
+
+    if (!reader.isOk()) {
+        error = "DARTLOG3 index truncated";
+        return false;
+    }
+
+    return true;
+}
+
+const Dartlog3Index& Dartlog3Reader::index() const {
+    return dartlogIndex;
+}
+
+QString Dartlog3Reader::errorString() const {
+    return error;
+}
+
+bool Dartlog3Reader::isInRange(const Dartlog3Block& block) const {
+    return block.offset + block.size <= (quint64) size;
+}
+
+bool Dartlog3Reader::inflateBlock(const Dartlog3Block& block, char* output, qint64 outputSize) const {
+    if (block.encoding != DARTLOG3_ENCODING_RAW || !isInRange(block))
+        return false;
+
+    uLongf have = outputSize;
+    int ret = uncompress((Bytef*) output, &have, (const Bytef*) data + block.offset, block.size);
+    return ret == Z_OK && (qint64) have == outputSize;
+}
+
+/**
+ * @brief Decompresses the sample times of a time block
+ */
+bool Dartlog3Reader::decodeTimeBlock(size_t timeBlock, std::vector<double>& times) const {
+    const Dartlog3Block& block = dartlogIndex.timeBlocks[timeBlock];
+    times.resize(block.count);
+
+    if (block.encoding == DARTLOG3_ENCODING_DELTA_OF_DELTA)
+        return isInRange(block) && DartlogEncoding::decodeTime(data + block.offset, block.size, block.count, times.data());
+
+    return inflateBlock(block, (char*) times.data(), (qint64) block.count * sizeof(double));
+}
+
+/**
+ * @brief Decompresses a value block and converts the values to double
+ */
+bool Dartlog3Reader::decodeValueBlock(const Dartlog3Column& column, size_t block, std::vector<double>& values) const {
+    const Dartlog3Block& valueBlock = column.blocks[block];
+    int typeSize = dartlogTypeSize(column.tag.type);
+    const char* encoded = data + valueBlock.offset;
+
+    values.resize(valueBlock.count);
+    if (valueBlock.encoding != DARTLOG3_ENCODING_RAW && !isInRange(valueBlock))
+        return false;
+
+    switch (valueBlock.encoding) {
+        case DARTLOG3_ENCODING_GORILLA:
+            return DartlogEncoding::isFloatType(column.tag.type) &&
+                   DartlogEncoding::decodeFloat(encoded, valueBlock.size, valueBlock.count, column.tag.type, values.data());
+        case DARTLOG3_ENCODING_VARINT:
+            return !DartlogEncoding::isFloatType(column.tag.type) &&
+                   DartlogEncoding::decodeVarint(encoded, valueBlock.size, valueBlock.count, column.tag.type, values.data());
+        case DARTLOG3_ENCODING_BITPACKED:
+            return !DartlogEncoding::isFloatType(column.tag.type) &&
+                   DartlogEncoding::decodeBitPacked(encoded, valueBlock.size, valueBlock.count, column.tag.type, values.data());
+    }
+
+    std::vector<char> raw((size_t) valueBlock.count * typeSize);
+    if (!inflateBlock(valueBlock, raw.data(), raw.size()))
+        return false;
+
+    for (quint32 i = 0; i < valueBlock.count; i++)
+        values[i] = dartlogValueToDouble(column.tag.type, raw.data() + (size_t) i * typeSize);
+    return true;
+}
+
+Dartlog3Writer::Dartlog3Writer(QIODevice* device, int level, bool useEncodings)
+    : device(device), level(level), useEncodings(useEncodings), offset(0) {
+}
+
+bool Dartlog3Writer::begin() {
+    return write(QByteArray(DARTLOG3_HEADER, sizeof(DARTLOG3_HEADER)));
+}
+
+/**
+ * @brief Starts a new column, a redefined tag always starts a new column
+ * @return The column to append the values of the tag to
+ */
+int Dartlog3Writer::addColumn(const DartlogTag& tag) {
+    PendingColumn column;
+    column.column.tag = tag;
+    columns.push_back(column);
+    return (int) columns.size() - 1;
+}
+
+/**
+ * @param timeResets Number of time resets of the log before the sample, a change ends the pending block
+ */
+bool Dartlog3Writer::append(int column, double time, const char* rawValue, quint32 timeResets) {
+    PendingColumn& pending = columns[column];
+
+    if (pending.count > 0 && pending.timeResets != timeResets && !flushColumn(pending))
+        return false;
+
+    if (pending.count == 0) {
+        pending.timeResets = timeResets;
+        pending.timeMin = time;
+        pending.timeMax = time;
+    }
+    pending.timeMin = qMin(pending.timeMin, time);
+    pending.timeMax = qMax(pending.timeMax, time);
+
+    put(pending.times, time);
+    pending.values.append(rawValue, dartlogTypeSize(pending.column.tag.type));
+    pending.count++;
+
+    if (pending.count >= DARTLOG3_BLOCK_SAMPLES)
+        return flushColumn(pending);
+    return true;
+}
+
+/**
+ * @brief Flushes all pending blocks and writes the index
+ */
+bool Dartlog3Writer::finish() {
+    for (PendingColumn& column : columns) {
+        if (column.count > 0 && !flushColumn(column))
+            return false;
+    }
+
+    QByteArray indexData;
+    put<quint32>(indexData, (quint32) timeBlocks.size());
+    for (const Dartlog3Block& block : timeBlocks) {
+        put<quint64>(indexData, block.offset);
+        put<quint32>(indexData, block.size);
+        put<quint32>(indexData, block.count);
+        put<quint8>(indexData, block.encoding);
+        put<double>(indexData, block.timeMin);
+        put<double>(indexData, block.timeMax);
+        put<quint32>(indexData, block.timeResets);
+    }
+
+    put<quint32>(indexData, (quint32) columns.size());
+    for (const PendingColumn& pending : columns) {
+        const Dartlog3Column& column = pending.column;
+        put<quint16>(indexData, column.tag.index);
+        put<quint8>(indexData, column.tag.type);
+        put<quint8>(indexData, column.tag.verbose ? DARTLOG3_FLAG_VERBOSE : 0);
+        putString(indexData, column.tag.name);
+        putString(indexData, column.tag.unit);
+
+        put<quint32>(indexData, (quint32) column.blocks.size());
+        for (const Dartlog3Block& block : column.blocks) {
+            put<quint32>(indexData, block.timeBlock);
+            put<quint64>(indexData, block.offset);
+            put<quint32>(indexData, block.size);
+            put<quint32>(indexData, block.count);
+            put<quint8>(indexData, block.encoding);
+        }
+    }
+
+    QByteArray compressedIndex;
+    Dartlog3Block indexBlock;
+    if (!compressBlock(indexData, compressedIndex) || !writeBlock(compressedIndex, DARTLOG3_ENCODING_RAW, indexBlock))
+        return false;
+
+    QByteArray trailer;
+    put<quint64>(trailer, indexBlock.offset);
+    put<quint32>(trailer, indexBlock.size);
+    put<quint32>(trailer, (quint32) indexData.size());
+    trailer.append(DARTLOG3_TRAILER_MAGIC, 4);
+    return write(trailer);
+}
+
+QString Dartlog3Writer::errorString() const {
+    return error;
+}
+
+bool Dartlog3Writer::write(const QByteArray& data) {
+    if (device->write(data) != data.size()) {
+        error = "Could not write file: " + device->errorString();
+        return false;
+    }
+    offset += data.size();
+    return true;
+}
+
+bool Dartlog3Writer::compressBlock(const QByteArray& data, QByteArray& compressed) {
+    uLongf compressedSize = compressBound(data.size());
+    compressed.resize(compressedSize);
+
+    if (compress2((Bytef*) compressed.data(), &compressedSize, (const Bytef*) data.constData(), data.size(), level) != Z_OK) {
+        error = "Could not compress block";
+        return false;
+    }
+    compressed.resize(compressedSize);
+    return true;
+}
+
+bool Dartlog3Writer::writeBlock(const QByteArray& data, quint8 encoding, Dartlog3Block& block) {
+    block.offset = offset;
+    block.size = data.size();
+    block.encoding = encoding;
+    return write(data);
+}
+
+/**
+ * @brief Writes the encoded block unless compressing the raw data gives a clearly smaller block
+ */
+bool Dartlog3Writer::writeEncodedBlock(const QByteArray& raw, const QByteArray& encoded, quint8 encoding, Dartlog3Block& block) {
+    QByteArray compressed;
+
+    if (!useEncodings) {
+        return compressBlock(raw, compressed) && writeBlock(compressed, DARTLOG3_ENCODING_RAW, block);
+    }
+
+    // Encoded blocks are cheaper to decode, only try zlib if the encoding did not help much
+    if (encoded.size() > raw.size() / 4) {
+        if (!compressBlock(raw, compressed))
+            return false;
+
+        if (compressed.size() * 4 < encoded.size() * 3)
+            return writeBlock(compressed, DARTLOG3_ENCODING_RAW, block);
+    }
+
+    return writeBlock(encoded, encoding, block);
+}
+
+bool Dartlog3Writer::flushColumn(PendingColumn& pending) {
+    // Share the time block with columns sampled at the same times
+    quint64 hash = hashBytes(pending.times);
+    auto cached = timeBlockCache.find(hash);
+
+    quint32 timeBlock;
+    if (cached != timeBlockCache.end() && cached->second.second == pending.times &&
+        timeBlocks[cached->second.first].timeResets == pending.timeResets)
+        timeBlock = cached->second.first;
+    else {
+        Dartlog3Block block;
+        block.count = pending.count;
+        block.timeMin = pending.timeMin;
+        block.timeMax = pending.timeMax;
+        block.timeResets = pending.timeResets;
+
+        QByteArray encoded;
+        DartlogEncoding::encodeTime((const double*) pending.times.constData(), pending.count, encoded);
+        if (!writeEncodedBlock(pending.times, encoded, DARTLOG3_ENCODING_DELTA_OF_DELTA, block))
+            return false;
+
+        timeBlock = (quint32) timeBlocks.size();
+        timeBlocks.push_back(block);
+
+        if (timeBlockCache.size() >= DARTLOG3_TIME_BLOCK_CACHE)
+            timeBlockCache.clear();
+        timeBlockCache[hash] = std::make_pair(timeBlock, pending.times);
+    }
+
+    Dartlog3Block block;
+    block.count = pending.count;
+    block.timeBlock = timeBlock;
+
+    // Floats use the XOR encoding, integers the smaller of delta varints and bit packing
+    uint8_t type = pending.column.tag.type;
+    QByteArray encoded;
+    quint8 encoding;
+    if (DartlogEncoding::isFloatType(type)) {
+        DartlogEncoding::encodeFloat(pending.values.constData(), pending.count, type, encoded);
+        encoding = DARTLOG3_ENCODING_GORILLA;
+    }
+    else {
+        QByteArray bitPacked;
+        DartlogEncoding::encodeVarint(pending.values.constData(), pending.count, type, encoded);
+        DartlogEncoding::encodeBitPacked(pending.values.constData(), pending.count, type, bitPacked);
+        encoding = DARTLOG3_ENCODING_VARINT;
+        if (bitPacked.size() <= encoded.size()) {
+            encoded = bitPacked;
+            encoding = DARTLOG3_ENCODING_BITPACKED;
+        }
+    }
+
+    if (!writeEncodedBlock(pending.values, encoded, encoding, block))
+        return false;
+    pending.column.blocks.push_back(block);
+
+    pending.times.clear();
+    pending.values.clear();
+    pending.count = 0;
+    return true;
+}
+
+/**
+ * @brief Converts a DARTLOG or DARTLOG2 log (optionally gzip/LZ4 compressed) into a DARTLOG3 container
+ * @param inputFilename The log to convert
+ * @param outputFilename The DARTLOG3 file to write
+ * @param error Set if the conversion failed or stopped early
+ * @param useEncodings Use the time series encodings where they are smaller than zlib
+ * @return @c true if the whole log was converted, @c false otherwise
+ */
+bool convertToDartlog3(const QString& inputFilename, const QString& outputFilename, QString& error, bool useEncodings) {
+    DartlogInput input;
+    if (!input.open(inputFilename, nullptr)) {
+        error = input.errorString();
+        return false;
+    }
+
+    DartlogParser parser(input);
+    if (!parser.readHeader() || parser.version() >= 3) {
+        error = "Not a DARTLOG or DARTLOG2 file: header missing.";
+        return false;
+    }
+
+    QSaveFile output(outputFilename);
+    if (!output.open(QIODevice::WriteOnly)) {
+        error = "Could not open output file: " + output.errorString();
+        return false;
+    }
+
+    Dartlog3Writer writer(&output, -1, useEncodings);
+    if (!writer.begin()) {
+        error = writer.errorString();
+        return false;
+    }
+
+    std::unordered_map<uint16_t, int> columns;
+    bool complete = true;
+
+    while (true) {
+        DartlogParser::Record record = parser.next();
+
+        if (record == DartlogParser::End)
+            break;
+
+        if (record == DartlogParser::Error) {
+            // Keep everything read so far, as the plugin does
+            error = parser.errorString() + ": converted data up to the error";
+            complete = false;
+            break;
+        }
+
+        if (record == DartlogParser::TagDefinition)
+            columns[parser.tag().index] = writer.addColumn(parser.tag());
+        else if (!writer.append(columns[parser.valueID()], parser.time(), parser.rawValue(), parser.timeResets())) {
+            error = writer.errorString();
+            return false;
+        }
+    }
+
+    if (input.hasStreamError() || !input.warningString().isEmpty()) {
+        error = "Could not fully decompress file: data may be incomplete";
+        complete = false;
+    }
+
+    if (!writer.finish() || !output.commit()) {
+        error = writer.errorString().isEmpty() ? output.errorString() : writer.errorString();
+        return false;
+    }
+
+    return complete;
+}
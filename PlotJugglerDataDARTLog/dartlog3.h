@@ -0,0 +1,145 @@
+#pragma once
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QString>
+#include <unordered_map>
+#include <vector>
+
+#include "dartlog_format.h"
+
+/*
+ * DARTLOG3 container (all integers little endian)
+ *
+ *   "DARTLOG3\0"        header string, as for DARTLOG and DARTLOG2
+ *   block*              independently zlib compressed column blocks
+ *   index               zlib compressed index
+ *   trailer             uint64 index offset, uint32 compressed index size,
+ *                       uint32 index size, "D3I2" ("D3IX" before the time resets were stored)
+ *
+ * Every tag is stored as a column: a list of value blocks holding the raw
+ * values in their native type. Each value block refers to a time block
+ * holding the sample times as doubles. Tags sampled at the same times share
+ * their time blocks.
+ *
+ * Blocks are stored with one of the time series encodings of DartlogEncoding,
+ * or as zlib compressed raw data (encoding 0) where that is clearly smaller.
+ *
+ * Blocks end at every time reset of the log, so all samples of a time block
+ * share the number of time resets before them.
+ *
+ * Index:
+ *   uint32 time block count
+ *     uint64 offset, uint32 size, uint32 count, uint8 encoding,
+ *     double time min, double time max, uint32 time resets
+ *   uint32 column count
+ *     uint16 tag index, uint8 type, uint8 flags (bit 0: verbose),
+ *     name\0, unit\0, uint32 block count
+ *       uint32 time block, uint64 offset, uint32 size, uint32 count, uint8 encoding
+ */
+
+#define DARTLOG3_TRAILER_MAGIC "D3I2"
+#define DARTLOG3_TRAILER_MAGIC_V1 "D3IX"
+#define DARTLOG3_TRAILER_SIZE 20
+#define DARTLOG3_BLOCK_SAMPLES (64 * 1024)
+#define DARTLOG3_TIME_BLOCK_CACHE 1024
+
+#define DARTLOG3_ENCODING_RAW 0
+#define DARTLOG3_ENCODING_DELTA_OF_DELTA 1
+#define DARTLOG3_ENCODING_GORILLA 2
+#define DARTLOG3_ENCODING_VARINT 3
+#define DARTLOG3_ENCODING_BITPACKED 4
+
+#define DARTLOG3_FLAG_VERBOSE 0x01
+
+struct Dartlog3Block {
+    quint64 offset = 0;
+    quint32 size = 0;
+    quint32 count = 0;
+    quint8 encoding = DARTLOG3_ENCODING_RAW;
+
+    // Value blocks only
+    quint32 timeBlock = 0;
+
+    // Time blocks only
+    double timeMin = 0;
+    double timeMax = 0;
+    quint32 timeResets = 0;
+};
+
+struct Dartlog3Column {
+    DartlogTag tag;
+    std::vector<Dartlog3Block> blocks;
+};
+
+struct Dartlog3Index {
+    std::vector<Dartlog3Block> timeBlocks;
+    std::vector<Dartlog3Column> columns;
+};
+
+/**
+ * @brief Random access reader for DARTLOG3 containers, safe to decode blocks from multiple threads
+ */
+class Dartlog3Reader {
+public:
+    Dartlog3Reader(const char* data, qint64 size);
+
+    bool readIndex();
+    const Dartlog3Index& index() const;
+    QString errorString() const;
+
+    bool decodeTimeBlock(size_t timeBlock, std::vector<double>& times) const;
+    bool decodeValueBlock(const Dartlog3Column& column, size_t block, std::vector<double>& values) const;
+
+private:
+    const char* data;
+    qint64 size;
+    Dartlog3Index dartlogIndex;
+    QString error;
+
+    bool inflateBlock(const Dartlog3Block& block, char* output, qint64 outputSize) const;
+    bool isInRange(const Dartlog3Block& block) const;
+};
+
+/**
+ * @brief Writes a DARTLOG3 container sample by sample, flushing full blocks as they fill up
+ */
+class Dartlog3Writer {
+public:
+    explicit Dartlog3Writer(QIODevice* device, int level = -1, bool useEncodings = true);
+
+    bool begin();
+    int addColumn(const DartlogTag& tag);
+    bool append(int column, double time, const char* rawValue, quint32 timeResets = 0);
+    bool finish();
+
+    QString errorString() const;
+
+private:
+    struct PendingColumn {
+        Dartlog3Column column;
+        QByteArray times;
+        QByteArray values;
+        quint32 count = 0;
+        double timeMin = 0;
+        double timeMax = 0;
+        quint32 timeResets = 0;
+    };
+
+    QIODevice* device;
+    int level;
+    bool useEncodings;
+    quint64 offset;
+    std::vector<PendingColumn> columns;
+    std::vector<Dartlog3Block> timeBlocks;
+    std::unordered_map<quint64, std::pair<quint32, QByteArray>> timeBlockCache;
+    QString error;
+
+    bool write(const QByteArray& data);
+    bool compressBlock(const QByteArray& data, QByteArray& compressed);
+    bool writeBlock(const QByteArray& data, quint8 encoding, Dartlog3Block& block);
+    bool writeEncodedBlock(const QByteArray& raw, const QByteArray& encoded, quint8 encoding, Dartlog3Block& block);
+    bool flushColumn(PendingColumn& column);
+};
+
+bool convertToDartlog3(const QString& inputFilename, const QString& outputFilename, QString& error, bool useEncodings = true);
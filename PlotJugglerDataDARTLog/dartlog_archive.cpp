@@ -0,0 +1,410 @@
+#include "dartlog_archive.h"
+
+#include <climits>
+#include <cstring>
+#include <limits>
+
+#include "qcompressor.h"
+
+#define ZIP_LOCAL_HEADER 0x04034b50
+#define ZIP_CENTRAL_HEADER 0x02014b50
+#define ZIP_END_OF_DIRECTORY 0x06054b50
+#define ZIP64_END_OF_DIRECTORY 0x06064b50
+#define ZIP64_END_LOCATOR 0x07064b50
+#define ZIP64_EXTRA_FIELD 0x0001
+// End of central directory record without comment
+#define ZIP_END_SIZE 22
+#define ZIP_MAX_COMMENT 0xFFFF
+
+#define TAR_BLOCK_SIZE 512
+
+namespace {
+
+template <typename T>
+T get(const char* p) {
+    T v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/**
+ * @brief Reads a NUL terminated (or full) text field of a tar header
+ */
+QByteArray tarString(const char* field, int size) {
+    const char* end = (const char*) memchr(field, 0, size);
+    return QByteArray(field, end != nullptr ? (int) (end - field) : size);
+}
+
+/**
+ * @brief Reads a numeric field of a tar header: octal text, or base-256 if the high bit is set (GNU, sizes over 8 GB)
+ */
+qint64 tarNumber(const char* field, int size) {
+    const uchar* p = (const uchar*) field;
+    qint64 value = 0;
+
+    // Base-256, -1 if negative or too large
+    if (p[0] & 0x80) {
+        if (p[0] != 0x80)
+            return -1;
+        for (int i = 1; i < size; i++) {
+            if (value > (std::numeric_limits<qint64>::max() >> 8))
+                return -1;
+            value = (value << 8) | p[i];
+        }
+        return value;
+    }
+
+    for (int i = 0; i < size; i++) {
+        if (p[i] >= '0' && p[i] <= '7')
+            value = value * 8 + (p[i] - '0');
+        else if (p[i] != ' ' || value > 0)
+            break;
+    }
+    return value;
+}
+
+bool tarChecksumValid(const char* header) {
+    // Sum of all bytes with the checksum field taken as spaces
+    qint64 sum = 0;
+    for (int i = 0; i < TAR_BLOCK_SIZE; i++)
+        sum += (i >= 148 && i < 156) ? ' ' : (uchar) header[i];
+    return sum == tarNumber(header + 148, 8);
+}
+
+}
+
+DartlogArchive::DartlogArchive() : mapped(nullptr), data(nullptr), size(0), format(Zip) {
+}
+
+DartlogArchive::~DartlogArchive() {
+    close();
+}
+
+/**
+ * @brief Checks by extension if the given file is an archive of logs
+ */
+bool DartlogArchive::isArchive(const QString& filename) {
+    return filename.endsWith(".zip", Qt::CaseInsensitive) || filename.endsWith(".tar", Qt::CaseInsensitive)
+        || filename.endsWith(".tgz", Qt::CaseInsensitive) || filename.endsWith(".tar.gz", Qt::CaseInsensitive);
+}
+
+/**
+ * @brief Checks by extension if the given member of an archive is a log
+ */
+bool DartlogArchive::isLog(const QString& memberName) {
+    if (isArchive(memberName))
+        return false;
+    return memberName.endsWith(".dat", Qt::CaseInsensitive) || memberName.endsWith(".gz", Qt::CaseInsensitive)
+        || memberName.endsWith(".lz4", Qt::CaseInsensitive);
+}
+
+/**
+ * @brief Opens an archive and lists its members
+ * @param dialog Optional dialog to report the decompression of a .tar.gz to
+ * @return @c false if the file is not a readable archive (see errorString())
+ */
+bool DartlogArchive::open(const QString& filename, QProgressDialog* dialog) {
+    close();
+
+    file.setFileName(filename);
+    if (!file.open(QFile::ReadOnly)) {
+        error = "Could not open file";
+        return false;
+    }
+
+    if (filename.endsWith(".zip", Qt::CaseInsensitive))
+        format = Zip;
+    else if (filename.endsWith(".tar", Qt::CaseInsensitive))
+        format = Tar;
+    else
+        format = TarGZip;
+
+    // Members are read straight from the mapped file, read it only if it can not be mapped
+    size = file.size();
+    mapped = file.map(0, size);
+    if (mapped != nullptr)
+        data = (const char*) mapped;
+    else {
+        fileData = file.readAll();
+        data = fileData.constData();
+        size = fileData.size();
+    }
+
+    if (format == TarGZip) {
+        // A tar.gz can only be inflated front to back, so it is decompressed once for all members.
+        // Members cut off by a broken or canceled decompression are not listed.
+        if (dialog)
+            dialog->setLabelText("Decompressing archive... please wait");
+        QCompressor::gzipDecompress(data, size, tarData, dialog);
+
+        if (mapped != nullptr)
+            file.unmap(mapped);
+        mapped = nullptr;
+        fileData.clear();
+        data = nullptr;
+        size = 0;
+        file.close();
+    }
+
+    return format == Zip ? readZip() : readTar();
+}
+
+void DartlogArchive::close() {
+    if (mapped != nullptr) {
+        file.unmap(mapped);
+        mapped = nullptr;
+    }
+    file.close();
+    fileData.clear();
+    data = nullptr;
+    size = 0;
+    tarData.clear();
+    memberList.clear();
+    error.clear();
+}
+
+QString DartlogArchive::errorString() const {
+    return error;
+}
+
+const std::vector<DartlogArchiveMember>& DartlogArchive::members() const {
+    return memberList;
+}
+
+/**
+ * @brief Gives the (decompressed) content of a member, without copying stored members
+ *
+ * Thread-safe: only reads the archive, so members can be read concurrently.
+ * @param content Receives the content in chunks, valid as long as the archive is open
+ * @param readError Receives the reason if the member can not be read
+ */
+bool DartlogArchive::read(size_t member, DartlogBuffer& content, QString& readError) const {
+    const DartlogArchiveMember& m = memberList[member];
+    content.clear();
+
+    if (format == TarGZip) {
+        content.appendRaw(tarData, m.offset, m.size);
+        return true;
+    }
+
+    if (m.offset + m.compressedSize > size) {
+        readError = "Member cut off";
+        return false;
+    }
+
+    if (format == Tar || m.method == 0) {
+        content.appendRaw(data + m.offset, m.size);
+        return true;
+    }
+
+    if (m.method == 8) {
+        if (!QCompressor::inflateRaw(data + m.offset, m.compressedSize, content, m.size)) {
+            content.clear();
+            readError = "Could not decompress member";
+            return false;
+        }
+        return true;
+    }
+
+    readError = QString("Compression method %1 not supported").arg(m.method);
+    return false;
+}
+
+/**
+ * @brief Lists the members of a zip from its central directory
+ */
+bool DartlogArchive::readZip() {
+    // The end of central directory record is followed by a comment of up to 64 kB
+    qint64 end = -1;
+    for (qint64 p = size - ZIP_END_SIZE; p >= 0 && p >= size - ZIP_END_SIZE - ZIP_MAX_COMMENT; p--) {
+        if (get<quint32>(data + p) == ZIP_END_OF_DIRECTORY) {
+            end = p;
+            break;
+        }
+    }
+    if (end < 0) {
+        error = "Not a zip archive";
+        return false;
+    }
+
+    quint64 entries = get<quint16>(data + end + 10);
+    quint64 directorySize = get<quint32>(data + end + 12);
+    quint64 directoryOffset = get<quint32>(data + end + 16);
+
+    // Zip64 archives keep the real values in a record located right before
+    if (end >= 20 && get<quint32>(data + end - 20) == ZIP64_END_LOCATOR) {
+        quint64 end64 = get<quint64>(data + end - 20 + 8);
+        if (end64 + 56 <= (quint64) end && get<quint32>(data + end64) == ZIP64_END_OF_DIRECTORY) {
+            entries = get<quint64>(data + end64 + 32);
+            directorySize = get<quint64>(data + end64 + 40);
+            directoryOffset = get<quint64>(data + end64 + 48);
+        }
+    }
+
+    if (directoryOffset + directorySize > (quint64) size) {
+        error = "Zip archive cut off";
+        return false;
+    }
+
+    const char* p = data + directoryOffset;
+    const char* directoryEnd = p + directorySize;
+    for (quint64 i = 0; i < entries; i++) {
+        if (p + 46 > directoryEnd || get<quint32>(p) != ZIP_CENTRAL_HEADER) {
+            error = "Zip directory broken";
+            return false;
+        }
+
+        quint16 flags = get<quint16>(p + 8);
+        quint16 method = get<quint16>(p + 10);
+        quint64 compressedSize = get<quint32>(p + 20);
+        quint64 memberSize = get<quint32>(p + 24);
+        quint16 nameSize = get<quint16>(p + 28);
+        quint16 extraSize = get<quint16>(p + 30);
+        quint16 commentSize = get<quint16>(p + 32);
+        quint64 localOffset = get<quint32>(p + 42);
+
+        const char* extra = p + 46 + nameSize;
+        if (extra + extraSize + commentSize > directoryEnd) {
+            error = "Zip directory broken";
+            return false;
+        }
+
+        // Fields too large for 32 bits follow in this order in the zip64 extra field
+        for (const char* field = extra; field + 4 <= extra + extraSize;) {
+            quint16 id = get<quint16>(field);
+            quint16 fieldSize = get<quint16>(field + 2);
+            const char* value = field + 4;
+            const char* fieldEnd = value + fieldSize;
+
+            if (id == ZIP64_EXTRA_FIELD && fieldEnd <= extra + extraSize) {
+                if (memberSize == 0xFFFFFFFF && value + 8 <= fieldEnd) {
+                    memberSize = get<quint64>(value);
+                    value += 8;
+                }
+                if (compressedSize == 0xFFFFFFFF && value + 8 <= fieldEnd) {
+                    compressedSize = get<quint64>(value);
+                    value += 8;
+                }
+                if (localOffset == 0xFFFFFFFF && value + 8 <= fieldEnd)
+                    localOffset = get<quint64>(value);
+            }
+            field = fieldEnd;
+        }
+
+        QString name = QString::fromUtf8(p + 46, nameSize);
+        p = extra + extraSize + commentSize;
+
+        // Encrypted members can not be read
+        if (!isLog(name) || (flags & 0x01) != 0)
+            continue;
+
+        // The data follows the local header, whose extra field may differ from the central one
+        if (localOffset + 30 > (quint64) size || get<quint32>(data + localOffset) != ZIP_LOCAL_HEADER)
+            continue;
+
+        DartlogArchiveMember member;
+        member.name = name;
+        member.offset = localOffset + 30 + get<quint16>(data + localOffset + 26) + get<quint16>(data + localOffset + 28);
+        member.compressedSize = compressedSize;
+        member.size = memberSize;
+        member.method = method;
+        memberList.push_back(member);
+    }
+
+    return true;
+}
+
+qint64 DartlogArchive::tarSize() const {
+    return format == TarGZip ? tarData.size() : size;
+}
+
+/**
+ * @brief Gives a range of the (decompressed) tar, copied if it spans chunks of a .tar.gz
+ */
+const char* DartlogArchive::tarRange(qint64 offset, qint64 length, QByteArray& copy) const {
+    if (format != TarGZip)
+        return data + offset;
+
+    const char* range = tarData.range(offset, length);
+    if (range != nullptr)
+        return range;
+
+    copy.resize((int) length);
+    for (int i = 0; i < tarData.chunkCount(); i++) {
+        qint64 start = qMax(offset, tarData.chunkOffset(i));
+        qint64 end = qMin(offset + length, tarData.chunkOffset(i) + tarData.chunk(i).size());
+        if (start < end)
+            memcpy(copy.data() + (start - offset), tarData.chunk(i).constData() + (start - tarData.chunkOffset(i)), end - start);
+    }
+    return copy.constData();
+}
+
+/**
+ * @brief Lists the members of a tar by walking its headers
+ */
+bool DartlogArchive::readTar() {
+    qint64 total = tarSize();
+    QByteArray longName;
+
+    for (qint64 offset = 0; offset + TAR_BLOCK_SIZE <= total;) {
+        QByteArray copy;
+        const char* header = tarRange(offset, TAR_BLOCK_SIZE, copy);
+
+        // The archive ends with empty blocks
+        if (header[0] == 0)
+            break;
+
+        if (!tarChecksumValid(header)) {
+            if (offset == 0) {
+                error = "Not a tar archive";
+                return false;
+            }
+            break;
+        }
+
+        qint64 memberSize = tarNumber(header + 124, 12);
+        qint64 dataOffset = offset + TAR_BLOCK_SIZE;
+        char type = header[156];
+        if (memberSize < 0 || memberSize > total - dataOffset)
+            break;
+
+        // Names and pax records are read in one piece
+        if ((type == 'L' || type == 'x') && memberSize > INT_MAX)
+            break;
+
+        QByteArray name = tarString(header, 100);
+        if (memcmp(header + 257, "ustar", 5) == 0 && header[345] != 0)
+            name = tarString(header + 345, 155) + "/" + name;
+
+        if (type == 'L') {
+            // GNU long name of the next member
+            QByteArray nameCopy;
+            longName = tarString(tarRange(dataOffset, memberSize, nameCopy), (int) memberSize);
+        }
+        else if (type == 'x') {
+            // pax records "<length> <key>=<value>\n", only the path is used
+            QByteArray recordsCopy;
+            QByteArray records(tarRange(dataOffset, memberSize, recordsCopy), (int) memberSize);
+            for (const QByteArray& record : records.split('\n')) {
+                int path = record.indexOf(" path=");
+                if (path >= 0)
+                    longName = record.mid(path + 6);
+            }
+        }
+        else {
+            if ((type == '0' || type == 0 || type == '7') && isLog(QString::fromUtf8(longName.isEmpty() ? name : longName))) {
+                DartlogArchiveMember member;
+                member.name = QString::fromUtf8(longName.isEmpty() ? name : longName);
+                member.offset = dataOffset;
+                member.compressedSize = memberSize;
+                member.size = memberSize;
+                memberList.push_back(member);
+            }
+            longName.clear();
+        }
+
+        offset = dataOffset + (memberSize + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE;
+    }
+
+    return true;
+}
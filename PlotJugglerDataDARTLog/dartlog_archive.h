@@ -0,0 +1,72 @@
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <qprogressdialog.h>
+#include <vector>
+
+#include "dartlog_buffer.h"
+
+/*
+ * Archives of logs, read in place without extracting them:
+ *
+ *   .zip            members stored or deflated, zip64 for members and archives over 4 GB
+ *   .tar            members stored in 512 byte blocks (ustar, GNU long names, pax paths)
+ *   .tar.gz, .tgz   tar compressed as a whole, decompressed once into memory
+ *
+ * Stored members are given to the parser straight from the mapped archive, deflated members are
+ * inflated into memory. Reading members is thread-safe, so they can be loaded concurrently.
+ */
+
+struct DartlogArchiveMember {
+    QString name;
+    // Offset of the (compressed) data in the archive, in the decompressed tar for .tar.gz
+    qint64 offset = 0;
+    qint64 compressedSize = 0;
+    qint64 size = 0;
+    // Zip compression method: 0 stored, 8 deflated
+    int method = 0;
+};
+
+class DartlogArchive {
+public:
+    enum Format {
+        Zip,
+        Tar,
+        TarGZip
+    };
+
+    DartlogArchive();
+    ~DartlogArchive();
+
+    static bool isArchive(const QString& filename);
+    static bool isLog(const QString& memberName);
+
+    bool open(const QString& filename, QProgressDialog* dialog);
+    void close();
+
+    QString errorString() const;
+    const std::vector<DartlogArchiveMember>& members() const;
+
+    bool read(size_t member, DartlogBuffer& content, QString& readError) const;
+
+private:
+    QFile file;
+    uchar* mapped;
+    // Archive read into memory if it can not be mapped
+    QByteArray fileData;
+    const char* data;
+    qint64 size;
+    // Decompressed tar of a .tar.gz
+    DartlogBuffer tarData;
+
+    Format format;
+    std::vector<DartlogArchiveMember> memberList;
+    QString error;
+
+    bool readZip();
+    bool readTar();
+    qint64 tarSize() const;
+    const char* tarRange(qint64 offset, qint64 length, QByteArray& copy) const;
+};
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <QByteArray>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// Size of the chunks of a decompressed log, well below the 2 GB limit of a single QByteArray
+#define DARTLOG_BUFFER_CHUNK_SIZE (256 * 1024 * 1024)
+// Smallest chunk allocated by reserve()
+#define DARTLOG_BUFFER_MIN_CHUNK_SIZE (64 * 1024)
+
+/**
+ * @brief Decompressed log of any size, stored as a list of chunks with 64-bit offsets
+ */
+class DartlogBuffer {
+public:
+    DartlogBuffer() : used(0) {
+    }
+
+    void clear() {
+        chunks.clear();
+        offsets.clear();
+        used = 0;
+    }
+
+    qint64 size() const {
+        return chunks.empty() ? 0 : offsets.back() + used;
+    }
+
+    int chunkCount() const {
+        return (int) chunks.size();
+    }
+
+    const QByteArray& chunk(int i) const {
+        return chunks[i];
+    }
+
+    qint64 chunkOffset(int i) const {
+        return offsets[i];
+    }
+
+    /**
+     * @brief Gives space at the end to write to directly, e.g. to inflate into
+     *
+     * A new chunk is sized to the expected remaining size, so a known total size is allocated
+     * once. Without one (or beyond it) the chunks grow with the buffer.
+     * @param expected Number of bytes still expected, @c 0 if unknown
+     * @param available Receives the size of the space, at least one byte
+     */
+    char* reserve(qint64 expected, qint64* available) {
+        if (chunks.empty() || used == chunks.back().size()) {
+            qint64 size = expected > 0 ? expected : this->size();
+            size = std::min<qint64>(std::max<qint64>(size, DARTLOG_BUFFER_MIN_CHUNK_SIZE), DARTLOG_BUFFER_CHUNK_SIZE);
+
+            offsets.push_back(this->size());
+            chunks.emplace_back((int) size, Qt::Uninitialized);
+            used = 0;
+        }
+
+        *available = chunks.back().size() - used;
+        return chunks.back().data() + used;
+    }
+
+    // Marks bytes of the space given by reserve() as written
+    void commit(qint64 size) {
+        used += size;
+    }
+
+    /**
+     * @brief Releases the unused space at the end, call once writing is done before reading
+     */
+    void finish() {
+        if (chunks.empty() || used == chunks.back().size())
+            return;
+
+        if (used == 0) {
+            chunks.pop_back();
+            offsets.pop_back();
+            used = chunks.empty() ? 0 : chunks.back().size();
+            return;
+        }
+
+        chunks.back().resize((int) used);
+        chunks.back().squeeze();
+    }
+
+    /**
+     * @brief Appends a chunk of the given size to be written by the caller
+     * @return Start of the new chunk
+     */
+    char* addChunk(qint64 size) {
+        finish();
+        offsets.push_back(this->size());
+        chunks.emplace_back((int) size, Qt::Uninitialized);
+        used = size;
+        return chunks.back().data();
+    }
+
+    /**
+     * @brief Copies data to the end
+     * @param expected Number of bytes still expected including these, @c 0 if unknown (see reserve())
+     */
+    void append(const char* data, qint64 size, qint64 expected = 0) {
+        while (size > 0) {
+            qint64 available;
+            char* out = reserve(expected, &available);
+            qint64 n = std::min(available, size);
+            memcpy(out, data, n);
+            commit(n);
+            data += n;
+            size -= n;
+            expected = std::max<qint64>(expected - n, 0);
+        }
+    }
+
+    /**
+     * @brief Appends data kept elsewhere without copying it, e.g. a member of a mapped archive
+     *
+     * The data has to stay valid while the buffer is used.
+     */
+    void appendRaw(const char* data, qint64 size) {
+        finish();
+        while (size > 0) {
+            qint64 n = std::min<qint64>(size, DARTLOG_BUFFER_CHUNK_SIZE);
+            offsets.push_back(this->size());
+            chunks.push_back(QByteArray::fromRawData(data, (int) n));
+            used = n;
+            data += n;
+            size -= n;
+        }
+    }
+
+    /**
+     * @brief Appends a range of another buffer without copying it, the other buffer has to stay unchanged
+     */
+    void appendRaw(const DartlogBuffer& other, qint64 offset, qint64 size) {
+        int i = (int) (std::upper_bound(other.offsets.begin(), other.offsets.end(), offset) - other.offsets.begin()) - 1;
+        for (; i >= 0 && i < (int) other.chunks.size() && size > 0; i++) {
+            qint64 start = offset - other.offsets[i];
+            qint64 n = std::min<qint64>(size, other.chunks[i].size() - start);
+            appendRaw(other.chunks[i].constData() + start, n);
+            offset += n;
+            size -= n;
+        }
+    }
+
+    /**
+     * @brief Gives direct access to a range of the log
+     * @return @c nullptr if the range is not stored in a single chunk
+     */
+    const char* range(qint64 offset, qint64 size) const {
+        // Last chunk starting at or before the offset
+        int i = (int) (std::upper_bound(offsets.begin(), offsets.end(), offset) - offsets.begin()) - 1;
+        if (i < 0 || offset + size > offsets[i] + chunks[i].size())
+            return nullptr;
+        return chunks[i].constData() + (offset - offsets[i]);
+    }
+
+    /**
+     * @brief Copies a range of the log, which may span chunks
+     */
+    void copy(qint64 offset, qint64 size, char* output) const {
+        int i = (int) (std::upper_bound(offsets.begin(), offsets.end(), offset) - offsets.begin()) - 1;
+        for (; i >= 0 && i < (int) chunks.size() && size > 0; i++) {
+            qint64 start = offset - offsets[i];
+            qint64 n = std::min<qint64>(size, chunks[i].size() - start);
+            memcpy(output, chunks[i].constData() + start, n);
+            output += n;
+            offset += n;
+            size -= n;
+        }
+    }
+
+private:
+    std::vector<QByteArray> chunks;
+    std::vector<qint64> offsets;
+    // Bytes written to the last chunk
+    qint64 used;
+};
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Streaming min/max decimation (M4): of every time bucket only the first, the minimum,
+ * the maximum and the last sample are kept, so spikes stay visible with at most four points per bucket
+ */
+class DartlogDecimator {
+public:
+    explicit DartlogDecimator(double bucketWidth = 0) : width(bucketWidth), bucket(0), count(0) {
+    }
+
+    bool enabled() const {
+        return width > 0;
+    }
+
+    /**
+     * @brief Adds a sample, emitting the points of the previous bucket when the sample starts a new one
+     * @param output Called as @c output(time, value) for every kept point, in time order
+     */
+    template <typename Emit>
+    void add(double time, double value, Emit output) {
+        int64_t index = (int64_t) std::floor(time / width);
+        if (count > 0 && index != bucket)
+            flush(output);
+
+        Sample sample = { time, value };
+        if (count == 0) {
+            bucket = index;
+            first = sample;
+            min = sample;
+            max = sample;
+        }
+        else if (value < min.value)
+            min = sample;
+        else if (value > max.value)
+            max = sample;
+
+        last = sample;
+        count++;
+    }
+
+    /**
+     * @brief Emits the points of the current bucket, e.g. at the end of the log
+     */
+    template <typename Emit>
+    void flush(Emit output) {
+        if (count == 0)
+            return;
+
+        Sample samples[4] = { first, min, max, last };
+        if (max.time < min.time)
+            std::swap(samples[1], samples[2]);
+
+        // Each sample only once, although it may be first, extreme and last at the same time
+        output(samples[0].time, samples[0].value);
+        for (int i = 1; i < 4; i++) {
+            if (samples[i].time != samples[i - 1].time || samples[i].value != samples[i - 1].value)
+                output(samples[i].time, samples[i].value);
+        }
+        count = 0;
+    }
+
+private:
+    struct Sample {
+        double time;
+        double value;
+    };
+
+    double width;
+    int64_t bucket;
+    uint64_t count;
+    Sample first;
+    Sample min;
+    Sample max;
+    Sample last;
+};
+
+#define DARTLOG_OVERVIEW_FACTOR 16
+#define DARTLOG_OVERVIEW_LEVELS 3
+
+/**
+ * @brief Streaming min/max pyramid: level 0 keeps the minimum and maximum of every DARTLOG_OVERVIEW_FACTOR
+ * samples, every further level those of DARTLOG_OVERVIEW_FACTOR buckets of the level below
+ */
+class DartlogPyramid {
+public:
+    explicit DartlogPyramid(int levelCount = 0) : levels(levelCount) {
+    }
+
+    bool enabled() const {
+        return !levels.empty();
+    }
+
+    /**
+     * @param output Called as @c output(level, time, value) for the minimum and maximum of every finished bucket
+     */
+    template <typename Emit>
+    void add(double time, double value, Emit output) {
+        Sample sample = { time, value };
+        addBucket(0, sample, sample, output);
+    }
+
+    /**
+     * @brief Emits the unfinished buckets of all levels, e.g. at the end of the log
+     */
+    template <typename Emit>
+    void flush(Emit output) {
+        for (size_t level = 0; level < levels.size(); level++) {
+            Level& l = levels[level];
+            if (l.count == 0)
+                continue;
+
+            emitBucket(level, output);
+            if (level + 1 < levels.size())
+                addBucket(level + 1, l.min, l.max, output);
+            l.count = 0;
+        }
+    }
+
+private:
+    struct Sample {
+        double time;
+        double value;
+    };
+
+    struct Level {
+        Sample min;
+        Sample max;
+        int count = 0;
+    };
+
+    std::vector<Level> levels;
+
+    template <typename Emit>
+    void addBucket(size_t level, const Sample& min, const Sample& max, Emit output) {
+        Level& l = levels[level];
+        if (l.count == 0) {
+            l.min = min;
+            l.max = max;
+        }
+        else {
+            if (min.value < l.min.value)
+                l.min = min;
+            if (max.value > l.max.value)
+                l.max = max;
+        }
+
+        if (++l.count < DARTLOG_OVERVIEW_FACTOR)
+            return;
+
+        emitBucket(level, output);
+        l.count = 0;
+        if (level + 1 < levels.size())
+            addBucket(level + 1, l.min, l.max, output);
+    }
+
+    template <typename Emit>
+    void emitBucket(size_t level, Emit output) {
+        const Level& l = levels[level];
+        const Sample& first = l.min.time <= l.max.time ? l.min : l.max;
+        const Sample& second = l.min.time <= l.max.time ? l.max : l.min;
+
+        output((int) level, first.time, first.value);
+        if (second.time != first.time || second.value != first.value)
+            output((int) level, second.time, second.value);
+    }
+};
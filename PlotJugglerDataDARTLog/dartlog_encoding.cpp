@@ -0,0 +1,447 @@
+#include "dartlog_encoding.h"
+
+#include <cstring>
+
+#include "dartlog_format.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace {
+
+int countLeadingZeros(uint64_t x) {
+#ifdef _MSC_VER
+    unsigned long index;
+    return _BitScanReverse64(&index, x) ? 63 - (int) index : 64;
+#else
+    return x == 0 ? 64 : __builtin_clzll(x);
+#endif
+}
+
+int countTrailingZeros(uint64_t x) {
+#ifdef _MSC_VER
+    unsigned long index;
+    return _BitScanForward64(&index, x) ? (int) index : 64;
+#else
+    return x == 0 ? 64 : __builtin_ctzll(x);
+#endif
+}
+
+uint64_t zigZag(int64_t v) {
+    return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+int64_t unZigZag(uint64_t v) {
+    return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+void putVarint(QByteArray& output, uint64_t v) {
+    char buffer[10];
+    int length = 0;
+    while (v >= 0x80) {
+        buffer[length++] = (char) (v | 0x80);
+        v >>= 7;
+    }
+    buffer[length++] = (char) v;
+    output.append(buffer, length);
+}
+
+/**
+ * @brief Reads a varint, returns @c false if it runs past the end of the data
+ */
+inline bool getVarint(const uchar*& p, const uchar* end, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p >= end)
+            return false;
+        uchar b = *p++;
+        v |= (uint64_t) (b & 0x7F) << shift;
+        if (b < 0x80)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Loads the raw value as an integer preserving its order: signed values are biased by 2^63
+ */
+uint64_t loadOrdered(const char* raw, uint8_t type) {
+    switch (type) {
+        case DARTLOG_TYPE_UINT8: { uint8_t v; memcpy(&v, raw, sizeof(v)); return v; }
+        case DARTLOG_TYPE_UINT16: { uint16_t v; memcpy(&v, raw, sizeof(v)); return v; }
+        case DARTLOG_TYPE_UINT32: { uint32_t v; memcpy(&v, raw, sizeof(v)); return v; }
+        case DARTLOG_TYPE_UINT64: { uint64_t v; memcpy(&v, raw, sizeof(v)); return v; }
+        case DARTLOG_TYPE_INT8: { int8_t v; memcpy(&v, raw, sizeof(v)); return (uint64_t) (int64_t) v ^ (1ull << 63); }
+        case DARTLOG_TYPE_INT16: { int16_t v; memcpy(&v, raw, sizeof(v)); return (uint64_t) (int64_t) v ^ (1ull << 63); }
+        case DARTLOG_TYPE_INT32: { int32_t v; memcpy(&v, raw, sizeof(v)); return (uint64_t) (int64_t) v ^ (1ull << 63); }
+        case DARTLOG_TYPE_INT64: { int64_t v; memcpy(&v, raw, sizeof(v)); return (uint64_t) v ^ (1ull << 63); }
+    }
+    return 0;
+}
+
+inline double orderedToDouble(uint64_t v, bool isSigned) {
+    return isSigned ? (double) (int64_t) (v ^ (1ull << 63)) : (double) v;
+}
+
+/**
+ * @brief MSB first bit writer
+ */
+class BitWriter {
+public:
+    explicit BitWriter(QByteArray& output) : output(output), accumulator(0), used(0) {
+    }
+
+    void write(uint64_t value, int bits) {
+        if (bits == 0)
+            return;
+        if (bits < 64)
+            value &= (1ull << bits) - 1;
+
+        int free = 64 - used;
+        if (bits < free) {
+            accumulator |= value << (free - bits);
+            used += bits;
+            return;
+        }
+
+        accumulator |= value >> (bits - free);
+        flushWord(accumulator, 8);
+
+        int rest = bits - free;
+        accumulator = rest > 0 ? value << (64 - rest) : 0;
+        used = rest;
+    }
+
+    void finish() {
+        flushWord(accumulator, (used + 7) / 8);
+        accumulator = 0;
+        used = 0;
+    }
+
+private:
+    QByteArray& output;
+    uint64_t accumulator;
+    int used;
+
+    void flushWord(uint64_t word, int bytes) {
+        char buffer[8];
+        for (int i = 0; i < bytes; i++)
+            buffer[i] = (char) (word >> (56 - 8 * i));
+        output.append(buffer, bytes);
+    }
+};
+
+/**
+ * @brief MSB first bit reader, reading past the end sets an error flag
+ */
+class BitReader {
+public:
+    BitReader(const char* data, qint64 size) : data((const uchar*) data), size(size), bitPos(0), overrun(false) {
+    }
+
+    uint64_t read(int bits) {
+        if (bits == 0)
+            return 0;
+        if (bits > 56) {
+            uint64_t high = read(bits - 32);
+            return (high << 32) | read(32);
+        }
+
+        if (bitPos + bits > (uint64_t) size * 8) {
+            overrun = true;
+            return 0;
+        }
+
+        uint64_t word = loadWord(bitPos / 8);
+        uint64_t value = (word << (bitPos % 8)) >> (64 - bits);
+        bitPos += bits;
+        return value;
+    }
+
+    bool readBit() {
+        return read(1) != 0;
+    }
+
+    bool hasOverrun() const {
+        return overrun;
+    }
+
+private:
+    const uchar* data;
+    qint64 size;
+    uint64_t bitPos;
+    bool overrun;
+
+    uint64_t loadWord(uint64_t byte) const {
+        uint64_t word = 0;
+        if (byte + 8 <= (uint64_t) size) {
+            for (int i = 0; i < 8; i++)
+                word = (word << 8) | data[byte + i];
+        }
+        else {
+            for (int i = 0; i < 8; i++)
+                word = (word << 8) | (byte + i < (uint64_t) size ? data[byte + i] : 0);
+        }
+        return word;
+    }
+};
+
+}
+
+bool DartlogEncoding::isFloatType(uint8_t type) {
+    return type == DARTLOG_TYPE_FLOAT || type == DARTLOG_TYPE_DOUBLE;
+}
+
+bool DartlogEncoding::isSignedType(uint8_t type) {
+    return type == DARTLOG_TYPE_INT8 || type == DARTLOG_TYPE_INT16 || type == DARTLOG_TYPE_INT32 || type == DARTLOG_TYPE_INT64;
+}
+
+/**
+ * @brief Encodes the times as first value, first delta and the zig-zag varint coded delta-of-deltas
+ * of their bit patterns; evenly spaced times take a single byte per sample
+ */
+void DartlogEncoding::encodeTime(const double* times, size_t count, QByteArray& output) {
+    uint64_t previous = 0;
+    uint64_t previousDelta = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t bits;
+        memcpy(&bits, &times[i], sizeof(bits));
+
+        uint64_t delta = bits - previous;
+        putVarint(output, zigZag((int64_t) (delta - previousDelta)));
+
+        previous = bits;
+        previousDelta = delta;
+    }
+}
+
+bool DartlogEncoding::decodeTime(const char* data, qint64 size, size_t count, double* output) {
+    const uchar* p = (const uchar*) data;
+    const uchar* end = p + size;
+    uint64_t previous = 0;
+    uint64_t previousDelta = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t v;
+        if (!getVarint(p, end, v))
+            return false;
+
+        previousDelta += (uint64_t) unZigZag(v);
+        previous += previousDelta;
+        memcpy(&output[i], &previous, sizeof(previous));
+    }
+    return p == end;
+}
+
+/**
+ * @brief Gorilla XOR encoding: unchanged values take one bit, small changes only store the
+ * meaningful bits of the XOR with the previous value
+ */
+void DartlogEncoding::encodeFloat(const char* raw, size_t count, uint8_t type, QByteArray& output) {
+    const int width = type == DARTLOG_TYPE_FLOAT ? 32 : 64;
+    BitWriter writer(output);
+
+    uint64_t previous = 0;
+    int previousLeading = -1;
+    int previousTrailing = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t bits = 0;
+        memcpy(&bits, raw + i * (width / 8), width / 8);
+
+        if (i == 0) {
+            writer.write(bits, width);
+            previous = bits;
+            continue;
+        }
+
+        uint64_t x = bits ^ previous;
+        previous = bits;
+
+        if (x == 0) {
+            writer.write(0, 1);
+            continue;
+        }
+        writer.write(1, 1);
+
+        int leading = qMin(countLeadingZeros(x) - (64 - width), 31);
+        int trailing = countTrailingZeros(x);
+
+        if (previousLeading >= 0 && leading >= previousLeading && trailing >= previousTrailing) {
+            // Fits into the previous window
+            writer.write(0, 1);
+            writer.write(x >> previousTrailing, width - previousLeading - previousTrailing);
+        }
+        else {
+            int significant = width - leading - trailing;
+            writer.write(1, 1);
+            writer.write(leading, 5);
+            writer.write(significant & 63, 6);
+            writer.write(x >> trailing, significant);
+
+            previousLeading = leading;
+            previousTrailing = trailing;
+        }
+    }
+
+    writer.finish();
+}
+
+bool DartlogEncoding::decodeFloat(const char* data, qint64 size, size_t count, uint8_t type, double* output) {
+    const int width = type == DARTLOG_TYPE_FLOAT ? 32 : 64;
+    BitReader reader(data, size);
+
+    uint64_t bits = 0;
+    int leading = 0;
+    int trailing = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        if (i == 0)
+            bits = reader.read(width);
+        else if (reader.readBit()) {
+            if (reader.readBit()) {
+                leading = (int) reader.read(5);
+                int significant = (int) reader.read(6);
+                if (significant == 0)
+                    significant = 64;
+                trailing = width - leading - significant;
+                if (trailing < 0)
+                    return false;
+            }
+            bits ^= reader.read(width - leading - trailing) << trailing;
+        }
+
+        if (width == 32) {
+            uint32_t v32 = (uint32_t) bits;
+            float f;
+            memcpy(&f, &v32, sizeof(f));
+            output[i] = f;
+        }
+        else
+            memcpy(&output[i], &bits, sizeof(bits));
+    }
+
+    return !reader.hasOverrun();
+}
+
+void DartlogEncoding::encodeVarint(const char* raw, size_t count, uint8_t type, QByteArray& output) {
+    const int typeSize = dartlogTypeSize(type);
+    uint64_t previous = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t v = loadOrdered(raw + i * typeSize, type);
+        putVarint(output, zigZag((int64_t) (v - previous)));
+        previous = v;
+    }
+}
+
+bool DartlogEncoding::decodeVarint(const char* data, qint64 size, size_t count, uint8_t type, double* output) {
+    const bool isSigned = isSignedType(type);
+    const uchar* p = (const uchar*) data;
+    const uchar* end = p + size;
+    uint64_t previous = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t v;
+        if (!getVarint(p, end, v))
+            return false;
+
+        previous += (uint64_t) unZigZag(v);
+        output[i] = orderedToDouble(previous, isSigned);
+    }
+    return p == end;
+}
+
+/**
+ * @brief Stores the minimum value and every value as fixed width offset to it,
+ * constant signals take no space per sample
+ */
+void DartlogEncoding::encodeBitPacked(const char* raw, size_t count, uint8_t type, QByteArray& output) {
+    const int typeSize = dartlogTypeSize(type);
+
+    uint64_t minimum = UINT64_MAX;
+    uint64_t maximum = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t v = loadOrdered(raw + i * typeSize, type);
+        minimum = qMin(minimum, v);
+        maximum = qMax(maximum, v);
+    }
+    if (count == 0)
+        minimum = 0;
+
+    uint8_t width = (uint8_t) (64 - countLeadingZeros(maximum - minimum));
+    output.append((const char*) &minimum, sizeof(minimum));
+    output.append((const char*) &width, sizeof(width));
+
+    // LSB first packing
+    uint64_t accumulator = 0;
+    int used = 0;
+    for (size_t i = 0; i < count && width > 0; i++) {
+        uint64_t offset = loadOrdered(raw + i * typeSize, type) - minimum;
+
+        accumulator |= offset << used;
+        if (used + width >= 64) {
+            output.append((const char*) &accumulator, sizeof(accumulator));
+            int consumed = 64 - used;
+            accumulator = consumed < 64 ? offset >> consumed : 0;
+            used = used + width - 64;
+        }
+        else
+            used += width;
+    }
+    if (used > 0)
+        output.append((const char*) &accumulator, (used + 7) / 8);
+}
+
+bool DartlogEncoding::decodeBitPacked(const char* data, qint64 size, size_t count, uint8_t type, double* output) {
+    const bool isSigned = isSignedType(type);
+    if (size < 9)
+        return false;
+
+    uint64_t minimum;
+    uint8_t width;
+    memcpy(&minimum, data, sizeof(minimum));
+    memcpy(&width, data + 8, sizeof(width));
+
+    const uchar* packed = (const uchar*) data + 9;
+    const qint64 packedSize = size - 9;
+    if (width > 64 || packedSize != (qint64) (((uint64_t) count * width + 7) / 8))
+        return false;
+
+    if (width == 0) {
+        double v = orderedToDouble(minimum, isSigned);
+        for (size_t i = 0; i < count; i++)
+            output[i] = v;
+        return true;
+    }
+
+    const uint64_t mask = width == 64 ? UINT64_MAX : (1ull << width) - 1;
+
+    // Branch free main loop: every value lies within one unaligned 64 bit load
+    size_t i = 0;
+    if (width <= 56) {
+        for (; i < count; i++) {
+            uint64_t bit = (uint64_t) i * width;
+            uint64_t byte = bit / 8;
+            if (byte + 8 > (uint64_t) packedSize)
+                break;
+
+            uint64_t word;
+            memcpy(&word, packed + byte, sizeof(word));
+            output[i] = orderedToDouble(minimum + ((word >> (bit % 8)) & mask), isSigned);
+        }
+    }
+
+    // Tail and wide values
+    for (; i < count; i++) {
+        uint64_t bit = (uint64_t) i * width;
+        uint64_t v = 0;
+        for (int b = 0; b < width; b++, bit++)
+            v |= (uint64_t) ((packed[bit / 8] >> (bit % 8)) & 1) << b;
+        output[i] = orderedToDouble(minimum + v, isSigned);
+    }
+
+    return true;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <QByteArray>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Column encodings for slowly changing time series
+ *
+ * All decoders write a whole block at once into a double array and report
+ * malformed or truncated input by returning @c false.
+ */
+class DartlogEncoding
+{
+public:
+    // Delta-of-delta over the IEEE bit patterns of the times, zig-zag varint coded
+    static void encodeTime(const double* times, size_t count, QByteArray& output);
+    static bool decodeTime(const char* data, qint64 size, size_t count, double* output);
+
+    // Gorilla XOR encoding of float and double values
+    static void encodeFloat(const char* raw, size_t count, uint8_t type, QByteArray& output);
+    static bool decodeFloat(const char* data, qint64 size, size_t count, uint8_t type, double* output);
+
+    // Zig-zag varint of the deltas of integer values
+    static void encodeVarint(const char* raw, size_t count, uint8_t type, QByteArray& output);
+    static bool decodeVarint(const char* data, qint64 size, size_t count, uint8_t type, double* output);
+
+    // Frame-of-reference bit packing of integer values
+    static void encodeBitPacked(const char* raw, size_t count, uint8_t type, QByteArray& output);
+    static bool decodeBitPacked(const char* data, qint64 size, size_t count, uint8_t type, double* output);
+
+    static bool isFloatType(uint8_t type);
+    static bool isSignedType(uint8_t type);
+};
@@ -0,0 +1,61 @@
+#include "dartlog_export_dialog.h"
+#include <QDialogButtonBox>
+#include <QFormLayout>
+#include <QLabel>
+#include <QVBoxLayout>
+#include <cfloat>
+
+DartlogExportDialog::DartlogExportDialog(const std::vector<std::string> &tagNames, double timeMin, double timeMax, QWidget *parent)
+    : QDialog(parent) {
+    setWindowTitle("Export subset");
+
+    QLabel *label = new QLabel("Select the tags to export, nothing selected exports all tags. The time tag is always exported.");
+    label->setWordWrap(true);
+
+    _tag_list = new QListWidget();
+    _tag_list->setSelectionMode(QAbstractItemView::ExtendedSelection);
+    for (const std::string &name : tagNames)
+        _tag_list->addItem(QString::fromStdString(name));
+    _tag_list->setSortingEnabled(true);
+
+    _time_start = new QDoubleSpinBox();
+    _time_start->setDecimals(3);
+    _time_start->setRange(-DBL_MAX, DBL_MAX);
+    _time_start->setValue(timeMin);
+
+    _time_end = new QDoubleSpinBox();
+    _time_end->setDecimals(3);
+    _time_end->setRange(-DBL_MAX, DBL_MAX);
+    _time_end->setValue(timeMax);
+
+    QFormLayout *timeLayout = new QFormLayout();
+    timeLayout->addRow("Start time", _time_start);
+    timeLayout->addRow("End time", _time_end);
+
+    QDialogButtonBox *buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
+    connect(buttons, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
+
+    QVBoxLayout *layout = new QVBoxLayout();
+    layout->addWidget(label);
+    layout->addWidget(_tag_list);
+    layout->addLayout(timeLayout);
+    layout->addWidget(buttons);
+    setLayout(layout);
+    resize(400, 500);
+}
+
+std::vector<std::string> DartlogExportDialog::selectedTags() const {
+    std::vector<std::string> tags;
+    for (QListWidgetItem *item : _tag_list->selectedItems())
+        tags.push_back(item->text().toStdString());
+    return tags;
+}
+
+double DartlogExportDialog::timeStart() const {
+    return _time_start->value();
+}
+
+double DartlogExportDialog::timeEnd() const {
+    return _time_end->value();
+}
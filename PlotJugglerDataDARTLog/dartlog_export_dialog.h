@@ -0,0 +1,24 @@
+#pragma once
+
+#include <QDialog>
+#include <QDoubleSpinBox>
+#include <QListWidget>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Asks for the tags and the time range to export from a loaded log
+ */
+class DartlogExportDialog : public QDialog {
+public:
+    DartlogExportDialog(const std::vector<std::string> &tagNames, double timeMin, double timeMax, QWidget *parent = nullptr);
+
+    std::vector<std::string> selectedTags() const;
+    double timeStart() const;
+    double timeEnd() const;
+
+private:
+    QListWidget *_tag_list;
+    QDoubleSpinBox *_time_start;
+    QDoubleSpinBox *_time_end;
+};
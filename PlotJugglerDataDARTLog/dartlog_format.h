@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <string>
+
+#define DARTLOG_HEADER "DARTLOG"
+#define DARTLOG2_HEADER "DARTLOG2"
+#define DARTLOG3_HEADER "DARTLOG3"
+
+// ID escapes of DARTLOG2: one byte IDs, 254 = last ID + 1, 255 = full uint16 ID follows
+#define DARTLOG_ID_NEXT 254
+#define DARTLOG_ID_LONG 255
+
+// Tag attributes of DARTLOG2
+#define DARTLOG_ATTRIBUTE_END 0
+#define DARTLOG_ATTRIBUTE_UNIT 1
+#define DARTLOG_ATTRIBUTE_VERBOSE 2
+
+enum DartlogType : uint8_t {
+    DARTLOG_TYPE_UINT8 = 1,
+    DARTLOG_TYPE_UINT16 = 2,
+    DARTLOG_TYPE_UINT32 = 3,
+    DARTLOG_TYPE_INT8 = 4,
+    DARTLOG_TYPE_INT16 = 5,
+    DARTLOG_TYPE_INT32 = 6,
+    DARTLOG_TYPE_FLOAT = 7,
+    DARTLOG_TYPE_DOUBLE = 8,
+    DARTLOG_TYPE_UINT64 = 9,
+    DARTLOG_TYPE_INT64 = 10
+};
+
+struct DartlogTag {
+    uint16_t index = 0;
+    uint8_t type = 0;
+    std::string name;
+    std::string unit;
+    bool verbose = false;
+};
+
+inline bool dartlogIsValidType(uint8_t type) {
+    return type >= DARTLOG_TYPE_UINT8 && type <= DARTLOG_TYPE_INT64;
+}
+
+inline int dartlogTypeSize(uint8_t type) {
+    switch (type) {
+        case DARTLOG_TYPE_UINT8:
+        case DARTLOG_TYPE_INT8:
+            return 1;
+        case DARTLOG_TYPE_UINT16:
+        case DARTLOG_TYPE_INT16:
+            return 2;
+        case DARTLOG_TYPE_UINT32:
+        case DARTLOG_TYPE_INT32:
+        case DARTLOG_TYPE_FLOAT:
+            return 4;
+        case DARTLOG_TYPE_DOUBLE:
+        case DARTLOG_TYPE_UINT64:
+        case DARTLOG_TYPE_INT64:
+            return 8;
+    }
+    return 0;
+}
+
+template <typename T>
+inline double dartlogCast(const char* data) {
+    T v;
+    memcpy(&v, data, sizeof(v));
+    return (double) v;
+}
+
+inline double dartlogValueToDouble(uint8_t type, const char* data) {
+    switch (type) {
+        case DARTLOG_TYPE_UINT8: return dartlogCast<uint8_t>(data);
+        case DARTLOG_TYPE_UINT16: return dartlogCast<uint16_t>(data);
+        case DARTLOG_TYPE_UINT32: return dartlogCast<uint32_t>(data);
+        case DARTLOG_TYPE_INT8: return dartlogCast<int8_t>(data);
+        case DARTLOG_TYPE_INT16: return dartlogCast<int16_t>(data);
+        case DARTLOG_TYPE_INT32: return dartlogCast<int32_t>(data);
+        case DARTLOG_TYPE_FLOAT: return dartlogCast<float>(data);
+        case DARTLOG_TYPE_DOUBLE: return dartlogCast<double>(data);
+        case DARTLOG_TYPE_UINT64: return dartlogCast<uint64_t>(data);
+        case DARTLOG_TYPE_INT64: return dartlogCast<int64_t>(data);
+    }
+    return 0;
+}
+
+/**
+ * @brief Name of the series of a tag: '_' in the name become '/' levels, the unit is appended
+ * @param tagNames Names given so far, a name that is the start of another one or starts with another one
+ * gets "/Value" appended
+ */
+inline std::string dartlogSeriesName(const DartlogTag& tag, const std::string& prefix, std::set<std::string>& tagNames) {
+    std::string name = tag.name;
+    std::string unit = tag.unit;
+    std::replace(unit.begin(), unit.end(), '/', '_');
+    std::replace(name.begin(), name.end(), '_', '/');
+
+    if (!prefix.empty())
+        name = prefix + "/" + name;
+
+    // Check if the name is the start of a different value: such names sort directly after the name
+    auto next = tagNames.lower_bound(name);
+    bool collides = next != tagNames.end() && next->compare(0, name.size(), name) == 0;
+
+    // Check if a different value is the start of the name: such names sort before the name. If the closest
+    // name before is not the start, only names up to the start both have in common can be.
+    std::string probe = name;
+    while (!collides && !probe.empty()) {
+        auto before = tagNames.upper_bound(probe);
+        if (before == tagNames.begin())
+            break;
+        --before;
+
+        size_t length = std::min(before->size(), probe.size());
+        size_t common = std::mismatch(probe.begin(), probe.begin() + length, before->begin()).first - probe.begin();
+        collides = common == before->size();
+        probe.resize(common);
+    }
+
+    if (collides)
+        name += "/Value";
+
+    // Add unit
+    if (unit.length() > 0)
+        name += "_" + unit;
+
+    tagNames.insert(name);
+    return name;
+}
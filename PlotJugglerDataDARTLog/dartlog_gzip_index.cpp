@@ -0,0 +1,353 @@
+#include "dartlog_gzip_index.h"
+
+#include <QApplication>
+#include <QSaveFile>
+#include <atomic>
+#include <climits>
+#include <functional>
+#include <thread>
+
+#include "dartlog_input.h"
+#include "dartlog_parallel.h"
+#include "dartlog_parser.h"
+#include "qcompressor.h"
+
+namespace {
+
+template <typename T>
+void put(QByteArray& out, T v) {
+    out.append((const char*) &v, sizeof(v));
+}
+
+template <typename T>
+T get(const uchar* p) {
+    T v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/**
+ * @brief Appends an empty gzip member carrying the given data in an extra subfield
+ */
+void putExtraMember(QByteArray& out, char id1, char id2, const QByteArray& data) {
+    static const uchar header[] = { 0x1f, 0x8b, 0x08, 0x04, 0, 0, 0, 0, 0, 0xff };
+    out.append((const char*) header, sizeof(header));
+    put<uint16_t>(out, (uint16_t) (4 + data.size()));
+    out.append(id1);
+    out.append(id2);
+    put<uint16_t>(out, (uint16_t) data.size());
+    out.append(data);
+
+    // Empty final deflate block, CRC32 and size of nothing
+    static const uchar trailer[] = { 0x03, 0x00, 0, 0, 0, 0, 0, 0, 0, 0 };
+    out.append((const char*) trailer, sizeof(trailer));
+}
+
+/**
+ * @brief Finds the extra subfield with the given ID of the empty gzip member at @c p
+ * @return Size of the member, @c 0 if it is not an empty member with this subfield
+ */
+qint64 findExtraMember(const uchar* p, qint64 size, char id1, char id2, const uchar** data, uint16_t* dataSize) {
+    if (size < 12 || p[0] != 0x1f || p[1] != 0x8b || p[2] != 0x08 || p[3] != 0x04)
+        return 0;
+
+    uint16_t extraSize = get<uint16_t>(p + 10);
+    qint64 memberSize = 12 + extraSize + 10;
+    if (memberSize > size)
+        return 0;
+
+    const uchar* field = p + 12;
+    const uchar* end = field + extraSize;
+    while (field + 4 <= end) {
+        uint16_t fieldSize = get<uint16_t>(field + 2);
+        if (field + 4 + fieldSize > end)
+            return 0;
+
+        if (field[0] == id1 && field[1] == id2) {
+            *data = field + 4;
+            *dataSize = fieldSize;
+            return memberSize;
+        }
+        field += 4 + fieldSize;
+    }
+    return 0;
+}
+
+}
+
+/**
+ * @brief Reads the block index of an indexed gzip file
+ * @param file The whole compressed file
+ * @param size Size of the file in bytes
+ * @param blocks The data members of the file
+ * @return @c false if the file has no (valid) index
+ */
+bool DartlogGzipIndex::read(const char* file, qint64 size, std::vector<DartlogGzipBlock>& blocks) {
+    blocks.clear();
+
+    if (size < DARTLOG_GZIP_TRAILER_SIZE)
+        return false;
+
+    const uchar* start = (const uchar*) file;
+    const uchar* trailer;
+    uint16_t trailerSize;
+    if (findExtraMember(start + size - DARTLOG_GZIP_TRAILER_SIZE, DARTLOG_GZIP_TRAILER_SIZE, 'D', 'X', &trailer, &trailerSize) == 0
+        || trailerSize != DARTLOG_GZIP_TRAILER_DATA_SIZE)
+        return false;
+
+    quint64 indexOffset = get<quint64>(trailer);
+    quint64 uncompressedSize = get<quint64>(trailer + 8);
+    quint32 blockCount = get<quint32>(trailer + 16);
+
+    if (indexOffset > (quint64) size)
+        return false;
+
+    // Read the entries of all index members
+    const uchar* p = start + indexOffset;
+    const uchar* end = start + size - DARTLOG_GZIP_TRAILER_SIZE;
+    while (blocks.size() < blockCount) {
+        const uchar* entries;
+        uint16_t entriesSize;
+        qint64 memberSize = findExtraMember(p, end - p, 'D', 'I', &entries, &entriesSize);
+        if (memberSize == 0)
+            return false;
+
+        for (uint16_t i = 0; i + DARTLOG_GZIP_ENTRY_SIZE <= entriesSize; i += DARTLOG_GZIP_ENTRY_SIZE) {
+            DartlogGzipBlock block;
+            block.compressedOffset = get<quint64>(entries + i);
+            block.offset = get<quint64>(entries + i + 8);
+            block.time = get<float>(entries + i + 16);
+            block.lastID = get<uint16_t>(entries + i + 20);
+            block.flags = entries[i + 22];
+            blocks.push_back(block);
+        }
+        p += memberSize;
+    }
+
+    if (blocks.size() != blockCount) {
+        blocks.clear();
+        return false;
+    }
+
+    // Blocks end where the next one starts, each fits into a chunk of the decompressed log
+    for (size_t i = 0; i < blocks.size(); i++) {
+        quint64 compressedEnd = i + 1 < blocks.size() ? blocks[i + 1].compressedOffset : indexOffset;
+        quint64 end = i + 1 < blocks.size() ? blocks[i + 1].offset : uncompressedSize;
+
+        if (compressedEnd < blocks[i].compressedOffset || end < blocks[i].offset || (i == 0 && blocks[i].offset != 0)
+            || end - blocks[i].offset > DARTLOG_BUFFER_CHUNK_SIZE) {
+            blocks.clear();
+            return false;
+        }
+        blocks[i].compressedSize = compressedEnd - blocks[i].compressedOffset;
+        blocks[i].size = end - blocks[i].offset;
+    }
+    return true;
+}
+
+/**
+ * @brief Appends the index members and the trailer member for the given data members
+ * @param indexOffset Offset of the index in the file, directly after the last data member
+ */
+void DartlogGzipIndex::write(const std::vector<DartlogGzipBlock>& blocks, quint64 indexOffset, QByteArray& output) {
+    for (size_t first = 0; first < blocks.size(); first += DARTLOG_GZIP_INDEX_ENTRIES) {
+        QByteArray entries;
+        for (size_t i = first; i < blocks.size() && i < first + DARTLOG_GZIP_INDEX_ENTRIES; i++) {
+            put<quint64>(entries, blocks[i].compressedOffset);
+            put<quint64>(entries, blocks[i].offset);
+            put<float>(entries, blocks[i].time);
+            put<uint16_t>(entries, blocks[i].lastID);
+            put<uint8_t>(entries, blocks[i].flags);
+        }
+        putExtraMember(output, 'D', 'I', entries);
+    }
+
+    QByteArray trailer;
+    put<quint64>(trailer, indexOffset);
+    put<quint64>(trailer, blocks.empty() ? 0 : blocks.back().offset + blocks.back().size);
+    put<quint32>(trailer, (quint32) blocks.size());
+    putExtraMember(output, 'D', 'X', trailer);
+}
+
+/**
+ * @brief Decompresses all data members of an indexed gzip file on all cores
+ * @param file The whole compressed file
+ * @param blocks The data members, see read()
+ * @param output The decompressed log, every block is stored within a single chunk
+ * @param dialog Optional dialog to report progress to and to cancel the decompression
+ * @return @c true if all members were decompressed, @c false otherwise
+ */
+bool DartlogGzipIndex::decompress(const char* file, const std::vector<DartlogGzipBlock>& blocks, DartlogBuffer& output,
+                                  QProgressDialog* dialog) {
+    output.clear();
+
+    // The blocks have to follow each other without gaps, each no larger than a chunk
+    for (size_t i = 0; i < blocks.size(); i++) {
+        quint64 offset = i > 0 ? blocks[i - 1].offset + blocks[i - 1].size : 0;
+        if (blocks[i].offset != offset || blocks[i].size > DARTLOG_BUFFER_CHUNK_SIZE)
+            return false;
+    }
+
+    // Fill each chunk with whole blocks
+    std::vector<char*> outputs(blocks.size());
+    for (size_t first = 0; first < blocks.size();) {
+        size_t last = first + 1;
+        while (last < blocks.size() && blocks[last].offset + blocks[last].size - blocks[first].offset <= DARTLOG_BUFFER_CHUNK_SIZE)
+            last++;
+
+        quint64 chunkSize = blocks[last - 1].offset + blocks[last - 1].size - blocks[first].offset;
+        if (chunkSize > DARTLOG_BUFFER_CHUNK_SIZE)
+            return false;
+
+        char* chunk = output.addChunk((qint64) chunkSize);
+        for (size_t i = first; i < last; i++)
+            outputs[i] = chunk + (blocks[i].offset - blocks[first].offset);
+        first = last;
+    }
+
+    std::atomic<bool> failed(false);
+
+    auto inflateJob = [&](size_t i) {
+        const DartlogGzipBlock& block = blocks[i];
+        if (!QCompressor::gzipDecompress(file + block.compressedOffset, block.compressedSize, outputs[i], block.size))
+            failed = true;
+    };
+
+    std::function<bool(size_t)> progress;
+    if (dialog) {
+        dialog->setRange(0, (int) blocks.size());
+        progress = [dialog](size_t blocksDone) {
+            dialog->setValue((int) blocksDone);
+            QApplication::processEvents();
+            return !dialog->wasCanceled();
+        };
+    }
+
+    if (!parallelFor(blocks.size(), inflateJob, progress))
+        return false;
+    return !failed;
+}
+
+/**
+ * @brief Rewrites a log as indexed gzip: independent members ending at record boundaries, compressed on all cores
+ */
+bool recompressDartlogGzip(const QString& inputFilename, const QString& outputFilename, QString& error, int level) {
+    DartlogInput input;
+    if (!input.open(inputFilename, nullptr)) {
+        error = input.errorString();
+        return false;
+    }
+
+    if (!input.hasRandomAccess()) {
+        error = "Logs with linked LZ4 blocks can not be recompressed";
+        return false;
+    }
+
+    DartlogParser parser(input);
+    if (!parser.readHeader() || parser.version() >= 3) {
+        error = "Not a DARTLOG or DARTLOG2 file: header missing.";
+        return false;
+    }
+
+    // Cut the log into blocks at record boundaries
+    std::vector<DartlogGzipBlock> blocks;
+    DartlogGzipBlock block;
+    bool complete = true;
+
+    while (true) {
+        DartlogParser::Record record = parser.next();
+
+        if (record == DartlogParser::End)
+            break;
+
+        if (record == DartlogParser::Error) {
+            // The rest of the log is kept in the last block
+            error = parser.errorString() + ": indexed data up to the error";
+            complete = false;
+            break;
+        }
+
+        if (record == DartlogParser::TagDefinition)
+            block.flags |= DARTLOG_GZIP_FLAG_DEFINES_TAGS;
+
+        qint64 pos = input.getPos();
+        if (pos - (qint64) block.offset >= DARTLOG_GZIP_BLOCK_SIZE) {
+            block.size = pos - block.offset;
+            blocks.push_back(block);
+
+            DartlogParserState state = parser.state();
+            block = DartlogGzipBlock();
+            block.offset = pos;
+            block.time = state.time;
+            block.lastID = state.lastID;
+        }
+    }
+
+    qint64 size = input.getSize();
+    if ((qint64) block.offset < size) {
+        block.size = size - block.offset;
+        blocks.push_back(block);
+    }
+
+    if (input.hasStreamError() || !input.warningString().isEmpty()) {
+        error = "Could not fully decompress file: data may be incomplete";
+        complete = false;
+    }
+
+    QSaveFile output(outputFilename);
+    if (!output.open(QIODevice::WriteOnly)) {
+        error = "Could not open output file: " + output.errorString();
+        return false;
+    }
+
+    // Compress a batch of blocks at once on all cores
+    size_t batchSize = 4 * qMax(1u, std::thread::hardware_concurrency());
+    quint64 offset = 0;
+
+    for (size_t first = 0; first < blocks.size(); first += batchSize) {
+        size_t count = qMin(batchSize, blocks.size() - first);
+        std::vector<QByteArray> members(count);
+        std::atomic<bool> failed(false);
+
+        // Blocks spanning chunks of the decompressed log are copied
+        std::vector<QByteArray> copies(count);
+        std::vector<const char*> data(count);
+        for (size_t i = 0; i < count; i++) {
+            const DartlogGzipBlock& b = blocks[first + i];
+            data[i] = b.size <= INT_MAX ? input.mapRange(b.offset, b.size, copies[i]) : nullptr;
+            if (data[i] == nullptr) {
+                error = "Could not read data";
+                return false;
+            }
+        }
+
+        parallelFor(count, [&](size_t i) {
+            const DartlogGzipBlock& b = blocks[first + i];
+            if (!QCompressor::gzipCompress(QByteArray::fromRawData(data[i], (int) b.size), members[i], level))
+                failed = true;
+        });
+
+        if (failed) {
+            error = "Could not compress data";
+            return false;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            blocks[first + i].compressedOffset = offset;
+            if (output.write(members[i]) != members[i].size()) {
+                error = "Could not write file: " + output.errorString();
+                return false;
+            }
+            offset += members[i].size();
+        }
+    }
+
+    QByteArray index;
+    DartlogGzipIndex::write(blocks, offset, index);
+    if (output.write(index) != index.size() || !output.commit()) {
+        error = "Could not write file: " + output.errorString();
+        return false;
+    }
+
+    return complete;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <qprogressdialog.h>
+#include <cstdint>
+#include <vector>
+
+#include "dartlog_buffer.h"
+
+/*
+ * Indexed gzip (BGZF-style, all integers little endian)
+ *
+ *   data member*        independent gzip members of about DARTLOG_GZIP_BLOCK_SIZE
+ *                       uncompressed bytes, each ending at a record boundary
+ *   index member+       empty gzip members with an extra subfield "DI" holding up to
+ *                       DARTLOG_GZIP_INDEX_ENTRIES entries:
+ *                         uint64 compressed offset, uint64 uncompressed offset,
+ *                         float time, uint16 last ID, uint8 flags (bit 0: block defines tags)
+ *   trailer member      empty gzip member with an extra subfield "DX":
+ *                         uint64 index offset, uint64 uncompressed size, uint32 block count
+ *
+ * Time and last ID are the parser state at the start of a block, so blocks without tag
+ * definitions can be parsed independently. Empty members decompress to nothing, so the
+ * file stays a valid gzip file of the original log for every other tool.
+ */
+
+#define DARTLOG_GZIP_BLOCK_SIZE (1024 * 1024)
+#define DARTLOG_GZIP_INDEX_ENTRIES 2048
+#define DARTLOG_GZIP_ENTRY_SIZE 23
+#define DARTLOG_GZIP_TRAILER_DATA_SIZE 20
+// gzip header with extra field (12), subfield header (4), data, empty deflate block (2), gzip trailer (8)
+#define DARTLOG_GZIP_TRAILER_SIZE (12 + 4 + DARTLOG_GZIP_TRAILER_DATA_SIZE + 2 + 8)
+
+#define DARTLOG_GZIP_FLAG_DEFINES_TAGS 0x01
+
+struct DartlogGzipBlock {
+    quint64 compressedOffset = 0;
+    quint64 compressedSize = 0;
+    quint64 offset = 0;
+    quint64 size = 0;
+    float time = 0;
+    uint16_t lastID = 0;
+    uint8_t flags = 0;
+};
+
+class DartlogGzipIndex
+{
+public:
+    static bool read(const char* file, qint64 size, std::vector<DartlogGzipBlock>& blocks);
+    static void write(const std::vector<DartlogGzipBlock>& blocks, quint64 indexOffset, QByteArray& output);
+    static bool decompress(const char* file, const std::vector<DartlogGzipBlock>& blocks, DartlogBuffer& output,
+                           QProgressDialog* dialog);
+};
+
+bool recompressDartlogGzip(const QString& inputFilename, const QString& outputFilename, QString& error, int level = -1);
@@ -0,0 +1,691 @@
+#include "dartlog_input.h"
+
+#include "qcompressor.h"
+#include <climits>
+#include <cstring>
+
+// Independent LZ4 blocks are decompressed on all cores up front
+#define LZ4_PARALLEL_DECOMPRESSION 1
+// Members of indexed gzip files are decompressed on all cores up front
+#define GZIP_PARALLEL_DECOMPRESSION 1
+// Bytes of a plain file searched at once for the end of a string
+#define DARTLOG_STRING_WINDOW 256
+// Compressed bytes read in addition to the decompressed size wanted by openHead()
+#define DARTLOG_HEAD_MARGIN 1024
+
+DartlogInput::DartlogInput()
+    : inputChunk(-1), inputChunkOffset(0), inputFile(nullptr), inputBase(0), mapped(nullptr), pos(0), cut(false),
+      inputCompression(None) {
+}
+
+DartlogInput::~DartlogInput() {
+    close();
+}
+
+/**
+ * @brief Opens the given log, detecting the compression by magic number
+ * @param filename The file to open
+ * @param dialog Optional dialog to report the decompression progress to
+ * @param accessPoints Keep access points while decompressing a gzip log sequentially, see accessPoint()
+ * @return @c true if the file could be opened, @c false otherwise (see errorString())
+ */
+bool DartlogInput::open(const QString& filename, QProgressDialog* dialog, bool accessPoints) {
+    close();
+
+    file.setFileName(filename);
+    if (!file.open(QFile::ReadOnly)) {
+        error = "Could not open file";
+        return false;
+    }
+
+    // Detect compression by magic number
+    QByteArray magic = file.peek(4);
+    bool isGZip = magic.size() >= 2 && (uchar) magic[0] == 0x1f && (uchar) magic[1] == 0x8b;
+    bool isLZ4 = LZ4Frame::hasMagic(magic);
+
+    if (!isGZip && !isLZ4) {
+        // Stream the file in large blocks read ahead, directly read it if that is not possible.
+        // The file stays open to be mapped on demand (see mapAll()).
+        inputCompression = None;
+        readAhead.reset(new DartlogReadAhead());
+        if (!readAhead->open(filename)) {
+            readAhead.reset();
+            inputFile = &file;
+        }
+        return true;
+    }
+
+    // Do not directly read file
+    if (dialog)
+        dialog->setLabelText("Decompression... please wait");
+
+    // Decompress straight from the mapped file, read it only if it can not be mapped
+    qint64 size;
+    const char* compressed = mapFile(&size);
+    if (size == 0) {
+        error = "Could not read file";
+        return false;
+    }
+
+    if (isGZip)
+        openGzip(compressed, size, dialog, accessPoints);
+    else
+        openLZ4(compressed, size, dialog);
+
+    // Linked LZ4 blocks are decompressed while parsing, from the file kept mapped
+    if (!inputStream)
+        unmapFile();
+    return true;
+}
+
+/**
+ * @brief Opens a log stored in an archive, without extracting it to disk
+ *
+ * Stored members are read in place from the archive, which must stay open while reading.
+ * @param dialog Optional dialog to report the decompression progress to
+ */
+bool DartlogInput::open(const DartlogArchive& archive, size_t member, QProgressDialog* dialog) {
+    close();
+
+    if (!archive.read(member, compressedBuffer, error))
+        return false;
+
+    qint64 size = compressedBuffer.size();
+    if (size == 0) {
+        error = "Could not read file";
+        return false;
+    }
+
+    QByteArray magic((int) qMin<qint64>(size, 4), 0);
+    compressedBuffer.copy(0, magic.size(), magic.data());
+    bool isGZip = magic.size() >= 2 && (uchar) magic[0] == 0x1f && (uchar) magic[1] == 0x8b;
+    if (!isGZip && !LZ4Frame::hasMagic(magic)) {
+        inputCompression = None;
+        inputBuffer = compressedBuffer;
+        compressedBuffer.clear();
+        nextChunk();
+        return true;
+    }
+
+    if (dialog)
+        dialog->setLabelText("Decompression... please wait");
+
+    // Decompressed from one piece, copied if the member is kept in chunks
+    const char* compressed = compressedBuffer.range(0, size);
+    if (compressed == nullptr) {
+        compressedCopy.resize(size);
+        compressedBuffer.copy(0, size, compressedCopy.data());
+        compressedBuffer.clear();
+        compressed = compressedCopy.data();
+    }
+
+    if (isGZip)
+        openGzip(compressed, size, dialog, false);
+    else
+        openLZ4(compressed, size, dialog);
+
+    if (!inputStream)
+        unmapFile();
+    return true;
+}
+
+/**
+ * @brief Maps the open file, or reads it into memory if it can not be mapped
+ * @param size Receives the size of the file
+ */
+const char* DartlogInput::mapFile(qint64* size) {
+    *size = file.size();
+    mapped = file.map(0, *size);
+    if (mapped != nullptr)
+        return (const char*) mapped;
+
+    compressedCopy.resize(*size);
+    file.seek(0);
+    *size = qMax<qint64>(file.read(compressedCopy.data(), *size), 0);
+    return compressedCopy.data();
+}
+
+/**
+ * @brief Releases the compressed log once it is decompressed, see mapFile()
+ */
+void DartlogInput::unmapFile() {
+    if (mapped != nullptr) {
+        file.unmap(mapped);
+        mapped = nullptr;
+    }
+    file.close();
+    compressedBuffer.clear();
+    compressedCopy.clear();
+    compressedCopy.shrink_to_fit();
+}
+
+/**
+ * @brief Reads the open file from the given offset on into memory, in chunks; positions continue from the offset
+ */
+void DartlogInput::readFile(qint64 offset) {
+    file.seek(offset);
+    qint64 remaining = file.size() - offset;
+    while (remaining > 0) {
+        qint64 available;
+        char* out = inputBuffer.reserve(remaining, &available);
+        qint64 n = file.read(out, qMin(available, remaining));
+        if (n <= 0)
+            break;
+        inputBuffer.commit(n);
+        remaining -= n;
+    }
+    inputBuffer.finish();
+
+    inputBase = offset;
+    inputChunkOffset = offset;
+    inputChunk = -1;
+    nextChunk();
+}
+
+/**
+ * @brief Decompresses a gzip log into memory, on all cores if it is indexed
+ * @param accessPoints Keep access points while decompressing sequentially, which is slower
+ */
+void DartlogInput::openGzip(const char* compressed, qint64 size, QProgressDialog* dialog, bool accessPoints) {
+    inputCompression = GZip;
+
+    bool decompressed = false;
+    if (GZIP_PARALLEL_DECOMPRESSION && DartlogGzipIndex::read(compressed, size, gzipBlocks)) {
+        decompressed = DartlogGzipIndex::decompress(compressed, gzipBlocks, inputBuffer, dialog);
+        if (!decompressed)
+            gzipBlocks.clear();
+    }
+
+    // Fall back to sequential decompression, which also keeps the data up to a broken member
+    if (!decompressed && !QCompressor::gzipDecompress(compressed, size, inputBuffer, dialog, accessPoints ? &gzipPoints : nullptr))
+        warning = "Could not fully decompress file: data may be incomplete or fully missing";
+
+    nextChunk();
+}
+
+/**
+ * @brief Decompresses a LZ4 log with independent blocks on all cores, or streams it if the blocks are linked
+ */
+void DartlogInput::openLZ4(const char* compressed, qint64 size, QProgressDialog* dialog) {
+    inputCompression = LZ4;
+
+    // Linked blocks are decompressed while parsing, the compressed data has to stay available then
+    if (LZ4_PARALLEL_DECOMPRESSION && LZ4Frame::hasIndependentBlocks(compressed, size)) {
+        if (!LZ4Frame::decompress(compressed, size, inputBuffer, dialog))
+            warning = "Could not fully decompress file: data may be incomplete or fully missing";
+        nextChunk();
+    }
+    else
+        inputStream.reset(new LZ4FrameStream(compressed, size));
+}
+
+/**
+ * @brief Opens only the start of the given log, e.g. to read its first time without decompressing all of it
+ *
+ * Plain files and LZ4 streams are read as far as parsed; gzip files are decompressed up to @p size bytes.
+ * @param size Number of decompressed bytes available at least
+ */
+bool DartlogInput::openHead(const QString& filename, qint64 size) {
+    close();
+
+    file.setFileName(filename);
+    if (!file.open(QFile::ReadOnly)) {
+        error = "Could not open file";
+        return false;
+    }
+
+    QByteArray magic = file.peek(4);
+    bool isGZip = magic.size() >= 2 && (uchar) magic[0] == 0x1f && (uchar) magic[1] == 0x8b;
+
+    if (isGZip) {
+        // Compressed data is rarely larger than the data itself
+        QByteArray data = file.read(size + DARTLOG_HEAD_MARGIN);
+        file.close();
+
+        inputCompression = GZip;
+        qint64 available;
+        char* head = inputBuffer.reserve(size, &available);
+        qint64 n = QCompressor::gzipDecompressHead(data.constData(), data.size(), head, available);
+        if (n < 0) {
+            error = "Could not decompress file";
+            return false;
+        }
+        inputBuffer.commit(n);
+        inputBuffer.finish();
+        nextChunk();
+        return true;
+    }
+
+    if (LZ4Frame::hasMagic(magic)) {
+        // Only the blocks parsed are decompressed, from the file kept mapped
+        inputCompression = LZ4;
+        qint64 fileSize;
+        const char* compressed = mapFile(&fileSize);
+        inputStream.reset(new LZ4FrameStream(compressed, fileSize));
+        return true;
+    }
+
+    inputFile = &file;
+    inputCompression = None;
+    return true;
+}
+
+/**
+ * @brief Opens the log from the given offset on, e.g. only the data appended since it was loaded before
+ *
+ * Positions continue from @p offset. Plain logs are read from the offset on, gzip logs are inflated
+ * from an access point at or before it (see accessPoint()).
+ * @param point Access point of a gzip log, @c nullptr for a plain log
+ */
+bool DartlogInput::openTail(const QString& filename, qint64 offset, const GzipAccessPoint* point, QProgressDialog* dialog) {
+    close();
+
+    file.setFileName(filename);
+    if (!file.open(QFile::ReadOnly)) {
+        error = "Could not open file";
+        return false;
+    }
+
+    if (point == nullptr) {
+        if (offset > file.size() || !file.seek(offset)) {
+            error = "File is shorter than loaded before";
+            return false;
+        }
+
+        inputCompression = None;
+        readFile(offset);
+        file.close();
+        return true;
+    }
+
+    qint64 size;
+    const char* compressed = mapFile(&size);
+
+    inputCompression = GZip;
+    if (!QCompressor::gzipDecompressFrom(compressed, size, *point, inputBuffer, dialog, &gzipPoints))
+        warning = "Could not fully decompress file: data may be incomplete";
+    unmapFile();
+
+    // The output starts with the window of the point
+    inputBase = point->out - point->window.size();
+    nextChunk();
+    skip(offset - inputBase);
+    if (cut || getPos() != offset) {
+        error = "File is shorter than loaded before";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Reads from the given memory without copying it, e.g. a single block of an indexed file
+ */
+void DartlogInput::openBuffer(const char* data, qint64 size) {
+    close();
+    if (size <= INT_MAX) {
+        inputData = QByteArray::fromRawData(data, (int) size);
+        return;
+    }
+
+    // Larger buffers are referenced in chunks
+    inputBuffer.appendRaw(data, size);
+    nextChunk();
+}
+
+/**
+ * @brief Reads the log again from its start, e.g. for a second pass, without decompressing it again
+ * @return @c false if the log is read from the file or streamed, it has to be opened again then
+ */
+bool DartlogInput::rewind() {
+    if (inputFile != nullptr || inputStream || readAhead)
+        return false;
+
+    cut = false;
+    pos = 0;
+    if (inputBuffer.chunkCount() > 0) {
+        inputChunk = -1;
+        nextChunk();
+    }
+    return true;
+}
+
+void DartlogInput::close() {
+    unmapFile();
+    inputFile = nullptr;
+    inputStream.reset();
+    readAhead.reset();
+    gzipBlocks.clear();
+    gzipPoints.clear();
+    inputBase = 0;
+    inputData.clear();
+    inputBuffer.clear();
+    joinedBuffer.clear();
+    joinedBuffer.shrink_to_fit();
+    inputChunk = -1;
+    inputChunkOffset = 0;
+    pos = 0;
+    cut = false;
+    inputCompression = None;
+    error.clear();
+    warning.clear();
+}
+
+DartlogInput::Compression DartlogInput::compression() const {
+    return inputCompression;
+}
+
+QString DartlogInput::errorString() const {
+    return error;
+}
+
+QString DartlogInput::warningString() const {
+    return warning;
+}
+
+bool DartlogInput::hasStreamError() const {
+    return (inputStream && inputStream->hasError()) || (readAhead && readAhead->hasError());
+}
+
+/**
+ * @brief The independent blocks of an indexed gzip file, empty for all other files
+ */
+const std::vector<DartlogGzipBlock>& DartlogInput::blocks() const {
+    return gzipBlocks;
+}
+
+/**
+ * @brief Finds the last access point of a gzip log at or before the given offset, with its window
+ * @return @c false if there is none, e.g. for plain and LZ4 logs or indexed gzip logs decompressed in parallel
+ */
+bool DartlogInput::accessPoint(qint64 offset, GzipAccessPoint& point) const {
+    auto after = std::upper_bound(gzipPoints.begin(), gzipPoints.end(), offset,
+                                  [](qint64 value, const GzipAccessPoint& p) { return value < p.out; });
+    if (after == gzipPoints.begin())
+        return false;
+
+    point = *(after - 1);
+    if (!point.memberStart) {
+        qint64 start = std::max<qint64>(point.out - GZIP_WINDOW_SIZE, inputBase);
+        point.window.resize((int) (point.out - start));
+        inputBuffer.copy(start - inputBase, point.out - start, point.window.data());
+    }
+    return true;
+}
+
+/**
+ * @brief Gives random access to the whole (decompressed) log; plain files are memory mapped
+ *
+ * A log decompressed into several chunks is joined into one piece for this, a second copy in memory.
+ * Only readers that need the whole log at once use it (DARTLOG3); others use mapRange().
+ * @param data Start of the log
+ * @param size Size of the log in bytes
+ * @return @c false if the log is only available as a stream
+ */
+bool DartlogInput::mapAll(const char** data, qint64* size) {
+    if (inputStream)
+        return false;
+
+    if (inputBuffer.chunkCount() > 1) {
+        // Only joined for readers that need the whole log at once, the record parser walks the chunks
+        if (joinedBuffer.empty()) {
+            joinedBuffer.resize(inputBuffer.size());
+            for (int i = 0; i < inputBuffer.chunkCount(); i++)
+                memcpy(joinedBuffer.data() + inputBuffer.chunkOffset(i), inputBuffer.chunk(i).constData(), inputBuffer.chunk(i).size());
+        }
+        *data = joinedBuffer.data();
+        *size = (qint64) joinedBuffer.size();
+        return true;
+    }
+
+    if (inputFile != nullptr || readAhead) {
+        if (mapped == nullptr)
+            mapped = file.map(0, file.size());
+
+        if (mapped != nullptr) {
+            *data = (const char*) mapped;
+            *size = file.size();
+            return true;
+        }
+
+        // Mapping failed, read into memory instead and continue at the same position
+        qint64 at = getPos();
+        inputFile = nullptr;
+        readAhead.reset();
+        inputData.clear();
+        pos = 0;
+        readFile(0);
+        file.close();
+        skip(at);
+        return mapAll(data, size);
+    }
+
+    *data = inputData.constData();
+    *size = inputData.size();
+    return true;
+}
+
+/**
+ * @brief Gives direct access to a range of the (decompressed) log, e.g. a block of an indexed file
+ * @return @c nullptr if the range is not available at once
+ */
+const char* DartlogInput::mapRange(qint64 offset, qint64 size) {
+    if (inputBuffer.chunkCount() > 0)
+        return inputBuffer.range(offset - inputBase, size);
+
+    const char* data;
+    qint64 dataSize;
+    if (!mapAll(&data, &dataSize) || offset < 0 || offset + size > dataSize)
+        return nullptr;
+    return data + offset;
+}
+
+/**
+ * @brief Gives a range of the (decompressed) log, copied if it spans chunks
+ * @return @c nullptr if the range is not available, e.g. of a log with linked LZ4 blocks
+ */
+const char* DartlogInput::mapRange(qint64 offset, qint64 size, QByteArray& copy) {
+    const char* range = mapRange(offset, size);
+    if (range != nullptr || inputBuffer.chunkCount() == 0 || offset < inputBase || offset + size > getSize() || size > INT_MAX)
+        return range;
+
+    copy.resize((int) size);
+    inputBuffer.copy(offset - inputBase, size, copy.data());
+    return copy.constData();
+}
+
+/**
+ * @brief Checks if ranges of the log can be mapped, which is not possible for linked LZ4 blocks decompressed
+ * while parsing
+ */
+bool DartlogInput::hasRandomAccess() const {
+    return !inputStream;
+}
+
+qint64 DartlogInput::getPos() {
+    if (inputFile != nullptr)
+        return inputFile->pos();
+    if (inputStream)
+        return inputStream->pos();
+    return inputChunkOffset + pos;
+}
+
+qint64 DartlogInput::getSize() {
+    if (inputFile != nullptr)
+        return inputFile->size();
+    if (inputStream)
+        return inputStream->size();
+    if (readAhead)
+        return readAhead->size();
+    // Logs opened at an offset (see openTail()) end at the offset plus the data read
+    if (inputBuffer.chunkCount() > 0)
+        return inputBase + inputBuffer.size();
+    return inputChunkOffset + inputData.size();
+}
+
+bool DartlogInput::atEnd() {
+    if (inputFile != nullptr)
+        return inputFile->atEnd();
+    if (pos >= inputData.size()) {
+        if (inputStream)
+            nextStreamBlock();
+        else if (readAhead)
+            nextReadAheadBlock();
+        else
+            nextChunk();
+    }
+    return pos >= inputData.size();
+}
+
+/**
+ * @brief Checks if a read ran past the end, e.g. into a record cut off by the end of a log still being written
+ */
+bool DartlogInput::isCut() const {
+    return cut;
+}
+
+bool DartlogInput::nextStreamBlock() {
+    while (inputStream->readBlock(inputData)) {
+        pos = 0;
+        if (inputData.size() > 0)
+            return true;
+    }
+    return false;
+}
+
+bool DartlogInput::nextReadAheadBlock() {
+    // Positions continue from the end of the block before
+    inputChunkOffset += inputData.size();
+    pos = 0;
+    if (readAhead->readBlock(inputData))
+        return true;
+
+    inputData.clear();
+    return false;
+}
+
+bool DartlogInput::nextChunk() {
+    while (inputChunk + 1 < inputBuffer.chunkCount()) {
+        inputChunk++;
+        inputChunkOffset = inputBase + inputBuffer.chunkOffset(inputChunk);
+        inputData = inputBuffer.chunk(inputChunk);
+        pos = 0;
+        if (inputData.size() > 0)
+            return true;
+    }
+    return false;
+}
+
+qint64 DartlogInput::read(char* data, qint64 maxLen) {
+    if (inputFile != nullptr) {
+        qint64 n = inputFile->read(data, maxLen);
+        if (n < maxLen)
+            cut = true;
+        return n;
+    }
+
+    qint64 done = 0;
+    while (done < maxLen && !atEnd()) {
+        qint64 n = qMin(maxLen - done, (qint64) inputData.size() - pos);
+        memcpy(data + done, inputData.constData() + pos, n);
+        pos += n;
+        done += n;
+    }
+    if (done < maxLen)
+        cut = true;
+    return maxLen;
+}
+
+void DartlogInput::skip(qint64 bytes) {
+    if (inputFile != nullptr) {
+        if (inputFile->skip(bytes) < bytes)
+            cut = true;
+    }
+    else {
+        // May skip into the next stream block or chunk
+        while (bytes > 0 && !atEnd()) {
+            qint64 n = qMin(bytes, (qint64) inputData.size() - pos);
+            pos += n;
+            bytes -= n;
+        }
+        if (bytes > 0)
+            cut = true;
+    }
+}
+
+/**
+ * @brief Gives direct access to the next bytes if they are buffered in one piece, e.g. to decode a whole frame at once
+ * @return @c nullptr if fewer bytes are buffered or the file is read directly
+ */
+const char* DartlogInput::peek(qint64 size) {
+    if (inputFile != nullptr || atEnd() || pos + size > inputData.size())
+        return nullptr;
+    return inputData.constData() + pos;
+}
+
+// Skips bytes given by peek()
+void DartlogInput::advance(qint64 bytes) {
+    pos += bytes;
+}
+
+uint8_t DartlogInput::readUint8() {
+    uint8_t b;
+    read((char*)&b, sizeof(b));
+    return b;
+}
+
+uint16_t DartlogInput::readUint16() {
+    uint8_t b[2];
+    read((char *) b, sizeof(b));
+
+    return b[0] + b[1] * 256;
+}
+
+std::string DartlogInput::readString() {
+    std::string str;
+    readString(str);
+    return str;
+}
+
+/**
+ * @brief Reads a NUL terminated string, searching the terminator in bulk over the buffered data
+ * @param str Receives the string, its memory is reused (e.g. for the name of every tag definition)
+ */
+void DartlogInput::readString(std::string& str) {
+    str.clear();
+
+    if (inputFile != nullptr) {
+        char window[DARTLOG_STRING_WINDOW];
+        while (true) {
+            qint64 n = inputFile->peek(window, sizeof(window));
+            if (n <= 0) {
+                cut = true;
+                return;
+            }
+
+            const char* end = (const char*) memchr(window, 0, n);
+            if (end != nullptr) {
+                str.append(window, end - window);
+                inputFile->skip(end - window + 1);
+                return;
+            }
+            str.append(window, n);
+            inputFile->skip(n);
+        }
+    }
+
+    // A string may span multiple stream blocks
+    while (!atEnd()) {
+        const char* start = inputData.constData() + pos;
+        qint64 available = inputData.size() - pos;
+
+        const char* end = (const char*) memchr(start, 0, available);
+        if (end != nullptr) {
+            str.append(start, end - start);
+            pos += end - start + 1;
+            return;
+        }
+        str.append(start, available);
+        pos += available;
+    }
+    cut = true;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <qprogressdialog.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "dartlog_archive.h"
+#include "dartlog_buffer.h"
+#include "dartlog_gzip_index.h"
+#include "dartlog_read_ahead.h"
+#include "lz4frame.h"
+#include "qcompressor.h"
+
+/**
+ * @brief Byte source for the record parser: a plain file streamed with reads ahead of the parser
+ * (see DartlogReadAhead), or a gzip/LZ4 compressed file decompressed in memory (or streamed block by block);
+ * both also as member of an archive (see DartlogArchive)
+ *
+ * Decompressed gzip logs are kept in chunks (see DartlogBuffer), so they may exceed 2 GB;
+ * inputData is then the current chunk and pos the position within it.
+ */
+class DartlogInput {
+public:
+    enum Compression {
+        None,
+        GZip,
+        LZ4
+    };
+
+    DartlogInput();
+    ~DartlogInput();
+
+    bool open(const QString& filename, QProgressDialog* dialog, bool accessPoints = false);
+    bool open(const DartlogArchive& archive, size_t member, QProgressDialog* dialog);
+    bool openHead(const QString& filename, qint64 size);
+    bool openTail(const QString& filename, qint64 offset, const GzipAccessPoint* point, QProgressDialog* dialog);
+    void openBuffer(const char* data, qint64 size);
+    bool rewind();
+    void close();
+
+    Compression compression() const;
+    QString errorString() const;
+    QString warningString() const;
+    bool hasStreamError() const;
+    const std::vector<DartlogGzipBlock>& blocks() const;
+    bool accessPoint(qint64 offset, GzipAccessPoint& point) const;
+
+    bool mapAll(const char** data, qint64* size);
+    const char* mapRange(qint64 offset, qint64 size);
+    const char* mapRange(qint64 offset, qint64 size, QByteArray& copy);
+    bool hasRandomAccess() const;
+
+    qint64 getPos();
+    qint64 getSize();
+    bool atEnd();
+    bool isCut() const;
+    qint64 read(char* data, qint64 maxLen);
+    void skip(qint64 bytes);
+    const char* peek(qint64 size);
+    void advance(qint64 bytes);
+    uint8_t readUint8();
+    uint16_t readUint16();
+
+    std::string readString();
+    void readString(std::string& str);
+
+private:
+    QFile file;
+    QByteArray inputData;
+    DartlogBuffer inputBuffer;
+    std::vector<char> joinedBuffer;
+    // Compressed member of an archive, and the compressed log in one piece if it can not be mapped or spans
+    // chunks; both kept while the log is streamed
+    DartlogBuffer compressedBuffer;
+    std::vector<char> compressedCopy;
+    int inputChunk;
+    qint64 inputChunkOffset;
+    QFile* inputFile;
+    std::unique_ptr<LZ4FrameStream> inputStream;
+    std::unique_ptr<DartlogReadAhead> readAhead;
+    std::vector<DartlogGzipBlock> gzipBlocks;
+    // Access points of a gzip log decompressed sequentially, see accessPoint()
+    std::vector<GzipAccessPoint> gzipPoints;
+    // Offset in the log of the start of inputBuffer, see openTail()
+    qint64 inputBase;
+    uchar* mapped;
+    qint64 pos;
+    // A read ran past the end of the log
+    bool cut;
+
+    Compression inputCompression;
+    QString error;
+    QString warning;
+
+    const char* mapFile(qint64* size);
+    void unmapFile();
+    void readFile(qint64 offset);
+    void openGzip(const char* compressed, qint64 size, QProgressDialog* dialog, bool accessPoints);
+    void openLZ4(const char* compressed, qint64 size, QProgressDialog* dialog);
+    bool nextStreamBlock();
+    bool nextReadAheadBlock();
+    bool nextChunk();
+};
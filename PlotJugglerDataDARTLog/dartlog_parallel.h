@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// Set on threads running the jobs of a parallelFor(), see there
+inline bool& parallelForRunning() {
+    thread_local bool running = false;
+    return running;
+}
+
+/**
+ * @brief Runs @c job(i) for every @c i in @c [0, count) on all available cores
+ *
+ * Called from a job of another parallelFor(), e.g. decompressing a log while loading several logs at once,
+ * the jobs run one after another on the calling thread, as the outer jobs already use all cores.
+ * @param count The number of jobs
+ * @param job The job to run, must be safe to call from multiple threads
+ * @param progress Called periodically on the calling thread with the number of finished jobs,
+ *                 returning @c false cancels all jobs not yet started
+ * @return @c true if all jobs ran, @c false if canceled
+ */
+template <typename Job>
+bool parallelFor(size_t count, Job job, const std::function<bool(size_t)>& progress = nullptr) {
+    std::atomic<size_t> nextJob(0);
+    std::atomic<size_t> jobsDone(0);
+    std::atomic<bool> canceled(false);
+
+    auto worker = [&]() {
+        bool running = parallelForRunning();
+        parallelForRunning() = true;
+        while (!canceled) {
+            size_t i = nextJob++;
+            if (i >= count)
+                break;
+            job(i);
+            jobsDone++;
+        }
+        parallelForRunning() = running;
+    };
+
+    if (count == 0)
+        return true;
+
+    if (parallelForRunning()) {
+        for (size_t i = 0; i < count; i++) {
+            if (progress && !progress(i))
+                return false;
+            job(i);
+        }
+        return true;
+    }
+
+    // Without progress reporting the calling thread helps out
+    size_t threadCount = std::min((size_t) std::max(1u, std::thread::hardware_concurrency()), count);
+    if (!progress)
+        threadCount--;
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < threadCount; i++)
+        threads.emplace_back(worker);
+
+    if (progress) {
+        while (jobsDone < count && !canceled) {
+            if (!progress(jobsDone))
+                canceled = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+    else
+        worker();
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    return !canceled;
+}
@@ -0,0 +1,379 @@
+#include "dartlog_parser.h"
+
+DartlogParser::DartlogParser(DartlogInput& input)
+    : input(input), dartLogVersion(0), maxTagID(0), timeTagID(0), lastID(0), currentTime(0),
+      hasTime(false), resetCount(0), resetOffset(0), offsetResets(false), frame(nullptr),
+      frameData(nullptr), frameIndex(0), framePos(0), runStart(0), runFrame(nullptr), recordStart(0), recordLastID(0),
+      cutOffset(-1), currentID(0), currentType(0) {
+    memset(currentRaw, 0, sizeof(currentRaw));
+}
+
+/**
+ * @brief Reads the header string of the log
+ * @return @c true if the header names a known DARTLOG version, @c false otherwise
+ */
+bool DartlogParser::readHeader() {
+    std::string header = input.readString();
+
+    if (header == DARTLOG_HEADER)
+        dartLogVersion = 1;
+    else if (header == DARTLOG2_HEADER)
+        dartLogVersion = 2;
+    else if (header == DARTLOG3_HEADER)
+        dartLogVersion = 3;
+    else
+        return false;
+
+    return true;
+}
+
+int DartlogParser::version() const {
+    return dartLogVersion;
+}
+
+/**
+ * @brief Reads the next record: either a tag definition (see tag()) or a value (see valueID() and value())
+ */
+DartlogParser::Record DartlogParser::next() {
+    return dartLogVersion >= 2 ? next<2>() : next<1>();
+}
+
+/**
+ * @brief Reads the next record of a log of the given version, see dartlogDispatchVersion()
+ */
+template <int Version>
+DartlogParser::Record DartlogParser::next() {
+    // Continue a frame read at once
+    if (Version >= 2 && frame != nullptr)
+        return nextFrameValue();
+
+    if (input.atEnd())
+        return End;
+
+    // A record cut off by the end of the log is not read, see endOffset()
+    recordStart = input.getPos();
+    recordLastID = lastID;
+
+    // Read next tag
+    uint16_t id;
+    bool sequential = false;
+    if (Version >= 2) {
+        uint8_t idPart = input.readUint8();
+        if (idPart == DARTLOG_ID_LONG)
+            id = input.readUint16();
+        else if (idPart == DARTLOG_ID_NEXT) {
+            id = lastID + 1;
+            sequential = true;
+        }
+        else
+            id = idPart;
+    }
+    else
+        id = input.readUint16();
+
+    if (input.isCut())
+        return cutOff();
+    lastID = id;
+
+    if (id == 0)
+        return readTagDefinition();
+
+    // A known frame starts: read it at once if its escape bytes are all in place
+    if (Version >= 2 && !sequential) {
+        endRun();
+        if (!frames.empty()) {
+            auto known = frames.find(id);
+            if (known != frames.end() && startFrame(known->second))
+                return nextFrameValue();
+        }
+    }
+
+    if (id > maxTagID)
+        return fail("Invalid ID read: over max tag id");
+
+    auto it = tags.find(id);
+    if (it == tags.end())
+        return fail("Invalid ID read: unknown tag id");
+
+    if (Version >= 2) {
+        if (sequential)
+            extendRun(it->second);
+        else {
+            runStart = id;
+            runTypes.assign(1, it->second);
+        }
+    }
+
+    // Read value
+    currentID = id;
+    currentType = it->second;
+    input.read(currentRaw, dartlogTypeSize(currentType));
+    if (input.isCut())
+        return cutOff();
+    return valueRead();
+}
+
+template DartlogParser::Record DartlogParser::next<1>();
+template DartlogParser::Record DartlogParser::next<2>();
+
+/**
+ * @brief Checks the escape bytes of a learned frame at the current position
+ * @return @c false if the data does not match the frame, e.g. it ends early, it is then read record by record
+ */
+bool DartlogParser::startFrame(const DartlogFrame& known) {
+    const char* data = input.peek(known.ends.back());
+    if (data == nullptr)
+        return false;
+
+    for (size_t i = 1; i < known.offsets.size(); i++) {
+        if ((uint8_t) data[known.offsets[i] - 1] != DARTLOG_ID_NEXT)
+            return false;
+    }
+
+    frame = &known;
+    frameData = data;
+    frameIndex = 0;
+    framePos = 0;
+    return true;
+}
+
+DartlogParser::Record DartlogParser::nextFrameValue() {
+    uint32_t i = frameIndex++;
+    currentID = frame->startID + i;
+    currentType = frame->types[i];
+    memcpy(currentRaw, frameData + frame->offsets[i], dartlogTypeSize(currentType));
+
+    input.advance(frame->ends[i] - framePos);
+    framePos = frame->ends[i];
+    lastID = currentID;
+
+    // The frame may continue record by record, if the logger wrote more tags than before
+    if (frameIndex == frame->types.size()) {
+        runStart = frame->startID;
+        runTypes.clear();
+        runFrame = frame;
+        frame = nullptr;
+    }
+    return valueRead();
+}
+
+// Adds a tag read with the "last ID + 1" escape to the current run
+void DartlogParser::extendRun(uint8_t type) {
+    // A frame read at once is continued
+    if (runFrame != nullptr) {
+        runTypes = runFrame->types;
+        runFrame = nullptr;
+    }
+    if (!runTypes.empty())
+        runTypes.push_back(type);
+}
+
+/**
+ * @brief Stores the layout of the current run of sequential IDs as frame, once a tag with an explicit ID follows
+ */
+void DartlogParser::endRun() {
+    runFrame = nullptr;
+    if (runTypes.size() >= DARTLOG_FRAME_MIN_TAGS) {
+        DartlogFrame& learned = frames[runStart];
+        learned.startID = runStart;
+        learned.types = runTypes;
+        learned.offsets.clear();
+        learned.ends.clear();
+
+        uint32_t pos = 0;
+        for (uint8_t runType : runTypes) {
+            learned.offsets.push_back(pos);
+            pos += dartlogTypeSize(runType);
+            learned.ends.push_back(pos);
+            pos++;
+        }
+    }
+    runTypes.clear();
+}
+
+void DartlogParser::forgetFrames() {
+    frames.clear();
+    frame = nullptr;
+    runTypes.clear();
+    runFrame = nullptr;
+}
+
+/**
+ * @brief Finishes a value record, the raw value is read
+ */
+DartlogParser::Record DartlogParser::valueRead() {
+    // Only the time is converted here, other values on demand by value()
+    if (currentID == timeTagID) {
+        float time = (float) dartlogValueToDouble(currentType, currentRaw);
+
+        // The time went backwards, e.g. the logger restarted its clock
+        if (hasTime && time < currentTime) {
+            resetCount++;
+            if (offsetResets)
+                resetOffset += (double) currentTime - time;
+        }
+        currentTime = time;
+        hasTime = true;
+    }
+
+    return Value;
+}
+
+/**
+ * @brief Reads the rest of a tag definition record, after its ID 0
+ */
+DartlogParser::Record DartlogParser::readTagDefinition() {
+    // Types may change, frames are learned again
+    forgetFrames();
+
+    currentTag.index = input.readUint16();
+    currentTag.type = input.readUint8();
+
+    if (input.isCut())
+        return cutOff();
+    if (!dartlogIsValidType(currentTag.type))
+        return fail("Wrong tag type read");
+
+    input.readString(currentTag.name);
+
+    if (input.isCut())
+        return cutOff();
+    if (currentTag.name.length() == 0)
+        return fail("Empty tag name read");
+
+    currentTag.unit.clear();
+    currentTag.verbose = false;
+    if (dartLogVersion >= 2) {
+        while (true) {
+            uint8_t attributeType = input.readUint8();
+
+            if (input.isCut())
+                return cutOff();
+            if (attributeType == DARTLOG_ATTRIBUTE_END)
+                break;
+
+            uint8_t attributeLength = input.readUint8();
+
+            switch (attributeType) {
+                case DARTLOG_ATTRIBUTE_UNIT:
+                    input.readString(currentTag.unit);
+                    break;
+                case DARTLOG_ATTRIBUTE_VERBOSE:
+                    currentTag.verbose = input.readUint8() > 0;
+                    break;
+                default:
+                    input.skip(attributeLength);
+                    break;
+            }
+        }
+    }
+
+    // The tag is known once its definition is complete
+    if (input.isCut())
+        return cutOff();
+
+    tags[currentTag.index] = currentTag.type;
+    if (currentTag.index > maxTagID)
+        maxTagID = currentTag.index;
+
+    if (currentTag.name == "time")
+        timeTagID = currentTag.index;
+
+    return TagDefinition;
+}
+
+const DartlogTag& DartlogParser::tag() const {
+    return currentTag;
+}
+
+uint16_t DartlogParser::valueID() const {
+    return currentID;
+}
+
+uint8_t DartlogParser::valueType() const {
+    return currentType;
+}
+
+const char* DartlogParser::rawValue() const {
+    return currentRaw;
+}
+
+double DartlogParser::value() const {
+    return dartlogValueToDouble(currentType, currentRaw);
+}
+
+double DartlogParser::time() const {
+    return currentTime + resetOffset;
+}
+
+/**
+ * @brief Continues the time after every reset from the time before it, by offsetting all later times
+ */
+void DartlogParser::setOffsetTimeResets(bool enabled) {
+    offsetResets = enabled;
+}
+
+// Number of times the time went backwards so far
+uint32_t DartlogParser::timeResets() const {
+    return resetCount;
+}
+
+// Offset added to the time read, see setOffsetTimeResets()
+double DartlogParser::timeOffset() const {
+    return resetOffset;
+}
+
+QString DartlogParser::errorString() const {
+    return error;
+}
+
+/**
+ * @brief Offset of the record boundary parsing ended at: the end of the log, or the start of a record cut off
+ * by it, e.g. as the log is still being written. The state() is the one at this offset.
+ */
+qint64 DartlogParser::endOffset() {
+    return cutOffset >= 0 ? cutOffset : input.getPos();
+}
+
+DartlogParserState DartlogParser::state() const {
+    DartlogParserState state;
+    state.version = dartLogVersion;
+    state.tags = tags;
+    state.maxTagID = maxTagID;
+    state.timeTagID = timeTagID;
+    state.lastID = lastID;
+    state.time = currentTime;
+    state.hasTime = hasTime;
+    state.timeResets = resetCount;
+    state.timeOffset = resetOffset;
+    return state;
+}
+
+/**
+ * @brief Continues parsing with the given state, e.g. at a block boundary of an indexed file
+ */
+void DartlogParser::setState(const DartlogParserState& state) {
+    dartLogVersion = state.version;
+    tags = state.tags;
+    maxTagID = state.maxTagID;
+    timeTagID = state.timeTagID;
+    lastID = state.lastID;
+    currentTime = state.time;
+    forgetFrames();
+    hasTime = state.hasTime;
+    resetCount = state.timeResets;
+    resetOffset = state.timeOffset;
+    cutOffset = -1;
+}
+
+DartlogParser::Record DartlogParser::fail(const QString& message) {
+    error = message;
+    return Error;
+}
+
+// Ends parsing before the record being read, which the log ends within
+DartlogParser::Record DartlogParser::cutOff() {
+    lastID = recordLastID;
+    cutOffset = recordStart;
+    return End;
+}
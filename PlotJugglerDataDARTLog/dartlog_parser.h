@@ -0,0 +1,141 @@
+#pragma once
+
+#include <QString>
+#include <map>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "dartlog_format.h"
+#include "dartlog_input.h"
+
+/**
+ * @brief Everything the parser carries from one record to the next, to continue parsing at a record boundary
+ */
+struct DartlogParserState {
+    int version = 0;
+    std::map<uint16_t, uint8_t> tags;
+    uint16_t maxTagID = 0;
+    uint16_t timeTagID = 0;
+    uint16_t lastID = 0;
+    float time = 0;
+    bool hasTime = false;
+    uint32_t timeResets = 0;
+    double timeOffset = 0;
+};
+
+// Shortest run of sequential IDs learned as frame
+#define DARTLOG_FRAME_MIN_TAGS 4
+
+/**
+ * @brief Layout of a recurring run of tags written with the "last ID + 1" escape, e.g. a full frame of a
+ * DARTLOG2 logger: its first tag and the type and position of every value
+ */
+struct DartlogFrame {
+    uint16_t startID = 0;
+    std::vector<uint8_t> types;
+    // Start and end of every value, from the first value on; each value after the first follows an escape byte
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> ends;
+};
+
+/**
+ * @brief Reads the records of a DARTLOG/DARTLOG2 stream one by one
+ */
+class DartlogParser {
+public:
+    enum Record {
+        Value,
+        TagDefinition,
+        End,
+        Error
+    };
+
+    explicit DartlogParser(DartlogInput& input);
+
+    bool readHeader();
+    int version() const;
+
+    Record next();
+    template <int Version>
+    Record next();
+
+    const DartlogTag& tag() const;
+    uint16_t valueID() const;
+    uint8_t valueType() const;
+    const char* rawValue() const;
+    double value() const;
+    double time() const;
+
+    void setOffsetTimeResets(bool enabled);
+    uint32_t timeResets() const;
+    double timeOffset() const;
+
+    QString errorString() const;
+
+    qint64 endOffset();
+    DartlogParserState state() const;
+    void setState(const DartlogParserState& state);
+
+private:
+    DartlogInput& input;
+    int dartLogVersion;
+
+    std::map<uint16_t, uint8_t> tags;
+    uint16_t maxTagID;
+    uint16_t timeTagID;
+    uint16_t lastID;
+    float currentTime;
+
+    bool hasTime;
+    uint32_t resetCount;
+    double resetOffset;
+    bool offsetResets;
+
+    // Frames learned by start ID, the frame being read and the run of sequential IDs read so far
+    std::unordered_map<uint16_t, DartlogFrame> frames;
+    const DartlogFrame* frame;
+    const char* frameData;
+    uint32_t frameIndex;
+    uint32_t framePos;
+    uint16_t runStart;
+    std::vector<uint8_t> runTypes;
+    const DartlogFrame* runFrame;
+
+    // Start of the record being read and the last ID before it, see endOffset()
+    qint64 recordStart;
+    uint16_t recordLastID;
+    qint64 cutOffset;
+
+    DartlogTag currentTag;
+    uint16_t currentID;
+    uint8_t currentType;
+    char currentRaw[8];
+
+    QString error;
+
+    bool startFrame(const DartlogFrame& known);
+    Record nextFrameValue();
+    void extendRun(uint8_t type);
+    void endRun();
+    void forgetFrames();
+
+    Record readTagDefinition();
+    Record valueRead();
+    Record fail(const QString& message);
+    Record cutOff();
+};
+
+/**
+ * @brief Runs a decode loop specialized for the given DARTLOG version, decided once instead of on every record
+ *
+ * The loop is called as @c loop(std::integral_constant<int, Version>()) and reads its records with
+ * @c parser.next<Version>().
+ */
+template <typename Loop>
+void dartlogDispatchVersion(int version, Loop loop) {
+    if (version >= 2)
+        loop(std::integral_constant<int, 2>());
+    else
+        loop(std::integral_constant<int, 1>());
+}
@@ -0,0 +1,280 @@
+#include "dartlog_read_ahead.h"
+
+#include <QFile>
+
+#ifdef DARTLOG_IO_URING
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+DartlogReadAhead::DartlogReadAhead() : fileSize(0), error(false), finished(true), stopping(false) {
+#ifdef DARTLOG_IO_URING
+    ringReady = false;
+    fd = -1;
+    nextOffset = 0;
+#endif
+}
+
+DartlogReadAhead::~DartlogReadAhead() {
+    close();
+}
+
+/**
+ * @brief Starts reading the file ahead
+ * @return @c false if the file can not be opened
+ */
+bool DartlogReadAhead::open(const QString& filename) {
+    close();
+
+    // Open the file here to report errors, the reads use their own handle
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    fileSize = file.size();
+    file.close();
+    error = false;
+
+#ifdef DARTLOG_IO_URING
+    if (openRing(filename))
+        return true;
+#endif
+
+    finished = false;
+    stopping = false;
+    reader = std::thread(&DartlogReadAhead::readFile, this, filename);
+    return true;
+}
+
+/**
+ * @brief Stops reading and releases all blocks not read yet
+ */
+void DartlogReadAhead::close() {
+#ifdef DARTLOG_IO_URING
+    closeRing();
+#endif
+
+    if (reader.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        reader.join();
+    }
+
+    blocks.clear();
+    finished = true;
+}
+
+// Size of the file when it was opened
+qint64 DartlogReadAhead::size() const {
+    return fileSize;
+}
+
+// @c true if a read failed, the blocks read until then are still returned
+bool DartlogReadAhead::hasError() const {
+    return error;
+}
+
+/**
+ * @brief Returns the next block of the file, waiting for its read to complete if necessary
+ * @return @c false at the end of the file or after an error
+ */
+bool DartlogReadAhead::readBlock(QByteArray& block) {
+#ifdef DARTLOG_IO_URING
+    if (ringReady) {
+        if (reads.empty() || !waitRead())
+            return false;
+
+        block = std::move(reads.front().buffer);
+        bool truncated = reads.front().truncated;
+        reads.pop_front();
+
+        // Like the reader thread, stop at a failed read: the blocks after it do not continue the data
+        if (truncated)
+            cancelReads();
+        else
+            submitRead();
+        return !block.isEmpty();
+    }
+#endif
+
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [this] { return !blocks.empty() || finished; });
+    if (blocks.empty())
+        return false;
+
+    block = std::move(blocks.front());
+    blocks.pop_front();
+    lock.unlock();
+
+    // Make room for the next read
+    changed.notify_all();
+    return true;
+}
+
+/**
+ * @brief Reader thread: reads the file in large blocks as long as fewer than DARTLOG_READ_AHEAD_BLOCKS are queued
+ */
+void DartlogReadAhead::readFile(const QString& filename) {
+    QFile file(filename);
+    bool opened = file.open(QIODevice::ReadOnly);
+
+    while (opened) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [this] { return blocks.size() < DARTLOG_READ_AHEAD_BLOCKS || stopping; });
+            if (stopping)
+                break;
+        }
+
+        QByteArray block = file.read(DARTLOG_READ_AHEAD_BLOCK_SIZE);
+        if (block.isEmpty()) {
+            if (!file.atEnd())
+                error = true;
+            break;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            blocks.push_back(std::move(block));
+        }
+        changed.notify_all();
+    }
+
+    if (!opened)
+        error = true;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+    }
+    changed.notify_all();
+}
+
+#ifdef DARTLOG_IO_URING
+
+/**
+ * @brief Sets up the ring and submits the first DARTLOG_READ_AHEAD_BLOCKS reads
+ * @return @c false if io_uring is not available, e.g. on old kernels or when blocked by seccomp
+ */
+bool DartlogReadAhead::openRing(const QString& filename) {
+    fd = ::open(QFile::encodeName(filename).constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    if (io_uring_queue_init(DARTLOG_READ_AHEAD_BLOCKS, &ring, 0) < 0) {
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+
+    ringReady = true;
+    nextOffset = 0;
+    for (int i = 0; i < DARTLOG_READ_AHEAD_BLOCKS; i++)
+        submitRead();
+    return true;
+}
+
+void DartlogReadAhead::closeRing() {
+    if (!ringReady)
+        return;
+
+    cancelReads();
+    io_uring_queue_exit(&ring);
+    ::close(fd);
+    fd = -1;
+    ringReady = false;
+}
+
+/**
+ * @brief Drops all reads in flight and submits no further ones
+ */
+void DartlogReadAhead::cancelReads() {
+    nextOffset = fileSize;
+
+    // The kernel may still write into the buffers of reads in flight
+    while (!reads.empty()) {
+        if (!waitRead())
+            break;
+        reads.pop_front();
+    }
+    reads.clear();
+}
+
+/**
+ * @brief Submits the read of the next block of the file, if any
+ */
+void DartlogReadAhead::submitRead() {
+    if (nextOffset >= fileSize)
+        return;
+
+    Read read;
+    read.offset = nextOffset;
+    read.done = 0;
+    read.complete = false;
+    read.truncated = false;
+    read.buffer = QByteArray((int) qMin<qint64>(DARTLOG_READ_AHEAD_BLOCK_SIZE, fileSize - nextOffset), Qt::Uninitialized);
+    nextOffset += read.buffer.size();
+
+    // Elements of a deque stay in place when others are added or removed at the ends
+    reads.push_back(std::move(read));
+    queueRead(reads.back());
+}
+
+void DartlogReadAhead::queueRead(Read& read) {
+    io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+    if (sqe == nullptr) {
+        error = true;
+        read.buffer.resize((int) read.done);
+        read.complete = true;
+        read.truncated = true;
+        return;
+    }
+
+    io_uring_prep_read(sqe, fd, read.buffer.data() + read.done, (unsigned) (read.buffer.size() - read.done),
+                       (__u64) (read.offset + read.done));
+    io_uring_sqe_set_data(sqe, &read);
+    io_uring_submit(&ring);
+}
+
+/**
+ * @brief Handles completions until the oldest read is complete, resubmitting short reads for the rest of their block
+ * @return @c false if waiting for completions failed
+ */
+bool DartlogReadAhead::waitRead() {
+    Read& first = reads.front();
+
+    while (!first.complete) {
+        io_uring_cqe* cqe;
+        if (io_uring_wait_cqe(&ring, &cqe) < 0) {
+            error = true;
+            return false;
+        }
+
+        Read* read = (Read*) io_uring_cqe_get_data(cqe);
+        int result = cqe->res;
+        io_uring_cqe_seen(&ring, cqe);
+
+        if (result == -EINTR || result == -EAGAIN) {
+            queueRead(*read);
+        } else if (result <= 0) {
+            // Error or file truncated since it was opened: keep what was read
+            if (result < 0)
+                error = true;
+            read->buffer.resize((int) read->done);
+            read->complete = true;
+            read->truncated = true;
+        } else {
+            read->done += result;
+            if (read->done < read->buffer.size())
+                queueRead(*read);
+            else
+                read->complete = true;
+        }
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#ifdef DARTLOG_IO_URING
+#include <liburing.h>
+#endif
+
+// Size of every read and number of reads kept ahead of the parser
+#define DARTLOG_READ_AHEAD_BLOCK_SIZE (4 * 1024 * 1024)
+#define DARTLOG_READ_AHEAD_BLOCKS 4
+
+/**
+ * @brief Reads a file front to back with several large reads in flight, while the parser works on the blocks read before
+ *
+ * For plain logs read as a stream, e.g. on network file systems where every small read waits for a round trip.
+ * With DARTLOG_IO_URING (Linux, liburing) the reads are queued to io_uring; otherwise, or if the ring can not be
+ * set up, a reader thread keeps up to DARTLOG_READ_AHEAD_BLOCKS blocks ahead.
+ */
+class DartlogReadAhead {
+public:
+    DartlogReadAhead();
+    ~DartlogReadAhead();
+
+    bool open(const QString& filename);
+    void close();
+
+    qint64 size() const;
+    bool hasError() const;
+
+    bool readBlock(QByteArray& block);
+
+private:
+    qint64 fileSize;
+    std::atomic<bool> error;
+
+    // Reader thread
+    std::thread reader;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<QByteArray> blocks;
+    bool finished;
+    bool stopping;
+
+    void readFile(const QString& filename);
+
+#ifdef DARTLOG_IO_URING
+    struct Read {
+        QByteArray buffer;
+        qint64 offset;
+        qint64 done;
+        bool complete;
+        // Ended before the end of its block, after an error or when the file got shorter
+        bool truncated;
+    };
+
+    io_uring ring;
+    bool ringReady;
+    int fd;
+    qint64 nextOffset;
+    // Reads in flight, in file order
+    std::deque<Read> reads;
+
+    bool openRing(const QString& filename);
+    void closeRing();
+    void cancelReads();
+    void submitRead();
+    void queueRead(Read& read);
+    bool waitRead();
+#endif
+};
@@ -0,0 +1,51 @@
+#include "dartlog_resume.h"
+
+#include <QFile>
+#include <zlib.h>
+
+/**
+ * @brief Remembers where parsing of the log ended, once all of it is loaded
+ * @return @c false if the log can not be continued, e.g. LZ4 logs (offset is then 0)
+ */
+bool DartlogResume::capture(DartlogInput& input, DartlogParser& parser) {
+    offset = parser.endOffset();
+    state = parser.state();
+
+    gzip = input.compression() == DartlogInput::GZip;
+    if (gzip) {
+        if (!input.accessPoint(offset, inflatePoint))
+            offset = 0;
+        checkOffset = inflatePoint.in;
+    }
+    else if (input.compression() == DartlogInput::None)
+        checkOffset = offset;
+    else
+        offset = 0;
+
+    if (offset > 0)
+        checksum = fileChecksum(filename, checkOffset);
+    return offset > 0;
+}
+
+/**
+ * @brief Checks if the file still starts with the data loaded before, e.g. it was only appended to
+ */
+bool DartlogResume::matchesFile() const {
+    return offset > 0 && fileChecksum(filename, checkOffset) == checksum;
+}
+
+/**
+ * @brief CRC-32 of the DARTLOG_RESUME_CHECK_SIZE bytes of a file before the given offset
+ * @return @c 0 if the file is shorter
+ */
+quint32 DartlogResume::fileChecksum(const QString& filename, qint64 end) {
+    QFile file(filename);
+    qint64 start = qMax<qint64>(0, end - DARTLOG_RESUME_CHECK_SIZE);
+    if (!file.open(QFile::ReadOnly) || file.size() < end || !file.seek(start))
+        return 0;
+
+    QByteArray data = file.read(end - start);
+    if (data.size() != end - start)
+        return 0;
+    return (quint32) crc32(crc32(0L, Z_NULL, 0), (const Bytef*) data.constData(), (uInt) data.size());
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <QString>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "dartlog_input.h"
+#include "dartlog_parser.h"
+#include "qcompressor.h"
+
+// Bytes of the file before the resume point compared on reload, to tell an appended log from a rewritten one
+#define DARTLOG_RESUME_CHECK_SIZE (64 * 1024)
+
+/**
+ * @brief Where loading a log stopped and everything to continue there, so reloading a log that is still
+ * being written only decodes the data appended since
+ *
+ * Plain logs continue at the record boundary directly, gzip logs inflate from an access point before it.
+ */
+struct DartlogResume {
+    // Series of a tag, an empty name for skipped tags
+    struct Series {
+        std::string name;
+        uint32_t part = 0;
+    };
+
+    QString filename;
+    // Record boundary in the (decompressed) log loading stopped at, 0 if it can not be continued, and the parser state there
+    qint64 offset = 0;
+    DartlogParserState state;
+    bool gzip = false;
+    GzipAccessPoint inflatePoint;
+
+    // Checksum of the DARTLOG_RESUME_CHECK_SIZE file bytes before checkOffset
+    qint64 checkOffset = 0;
+    quint32 checksum = 0;
+
+    // Series of every tag ID defined, all series names given and the tag names
+    std::map<uint16_t, Series> series;
+    std::vector<std::string> seriesNames;
+    std::vector<std::string> tagNames;
+    double timeMin = 0;
+    double timeMax = 0;
+    uint32_t verboseSignalsIgnoredCount = 0;
+    // DartlogTimeReset the log was loaded with
+    int timeReset = 0;
+
+    bool capture(DartlogInput& input, DartlogParser& parser);
+    bool matchesFile() const;
+
+    static quint32 fileChecksum(const QString& filename, qint64 end);
+};
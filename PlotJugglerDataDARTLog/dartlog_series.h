@@ -0,0 +1,282 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#include "PlotJuggler/plotdata.h"
+#include "dartlog_decimation.h"
+#include "dartlog_staging.h"
+
+/**
+ * @brief Handling of the time going backwards, e.g. when the logger restarts its clock
+ */
+enum class DartlogTimeReset {
+    // Sort every series once at the end, as if each sample was inserted in order
+    Sort,
+    // Continue in new series <series>_part<n> after every reset
+    Split,
+    // Offset all later times, so the time continues monotonically
+    Offset
+};
+
+/**
+ * @brief Output of one tag into its series: adds every sample, only the changes or the decimated samples,
+ * optionally with overview series of the minimum and maximum at lower resolutions
+ */
+class DartlogSeries {
+public:
+    explicit DartlogSeries(PJ::PlotData *data = nullptr, double decimationWidth = 0, bool changesOnly = false)
+        : data(data), decimator(decimationWidth), changesOnly(changesOnly), hasLastValue(false), holding(false),
+          lastTime(0), lastValue(0), sampleCount(0), pointCount(0), part(0), sortSamples(false), sorting(false),
+          hasSample(false), lastSampleTime(0) {
+    }
+
+    // Not loaded, e.g. verbose tags
+    bool isSkipped() const {
+        return data == nullptr;
+    }
+
+    /**
+     * @brief Also builds a min/max pyramid of all samples into the given series, one per level
+     */
+    void setOverviews(const std::vector<PJ::PlotData *> &series) {
+        overviews = series;
+        pyramid = DartlogPyramid((int) series.size());
+    }
+
+    /**
+     * @brief Continues in the series given by the factory once the part of a sample changes, see DartlogTimeReset::Split
+     * @param finisher Finishes the series of the part before, instead of finish()
+     */
+    void setParts(uint32_t firstPart, const std::function<DartlogSeries(uint32_t)> &factory,
+                  const std::function<void(DartlogSeries &)> &finisher) {
+        part = firstPart;
+        partFactory = factory;
+        partFinisher = finisher;
+    }
+
+    /**
+     * @brief Buffers the samples once the time goes backwards and sorts them at the end, instead of
+     * the series inserting every later sample in order
+     */
+    void setSortSamples(bool sort) {
+        sortSamples = sort;
+    }
+
+    /**
+     * @param samplePart Number of time resets before the sample, only used with setParts()
+     */
+    void push(double time, double value, uint32_t samplePart = 0) {
+        if (samplePart != part && partFactory) {
+            DartlogSeries next = partFactory(samplePart);
+            partFinisher(*this);
+            *this = std::move(next);
+        }
+        sampleCount++;
+
+        if (sortSamples) {
+            if (!sorting && hasSample && time < lastSampleTime)
+                startSorting();
+            hasSample = true;
+            lastSampleTime = time;
+
+            if (sorting) {
+                pending.push_back(PJ::PlotData::Point(time, value));
+                return;
+            }
+        }
+        process(time, value);
+    }
+
+    /**
+     * @brief Pushes a column of staged values, converted by DartlogStaging::convert()
+     * @param timeOffset Added to every time
+     */
+    void push(const DartlogStaging::Column &column, const std::vector<double> &times, double timeOffset = 0,
+              uint32_t samplePart = 0) {
+        size_t count = column.values.size();
+        if (count == 0)
+            return;
+
+        // Without filters and in order, the whole column is appended in one loop
+        if ((samplePart == part || !partFactory) && !sorting && !changesOnly && !decimator.enabled() &&
+            !pyramid.enabled() && inOrder(column, times, timeOffset)) {
+            for (size_t i = 0; i < count; i++)
+                data->pushBack(PJ::PlotData::Point(times[column.timeIndices[i]] + timeOffset, column.values[i]));
+
+            sampleCount += count;
+            pointCount += count;
+            hasSample = true;
+            lastSampleTime = times[column.timeIndices[count - 1]] + timeOffset;
+            return;
+        }
+
+        for (size_t i = 0; i < count; i++)
+            push(times[column.timeIndices[i]] + timeOffset, column.values[i], samplePart);
+    }
+
+    /**
+     * @brief Adds the points still held back, call once the tag has no more samples
+     */
+    void finish() {
+        if (data == nullptr)
+            return;
+
+        if (sorting) {
+            sorting = false;
+            std::stable_sort(pending.begin(), pending.end(),
+                             [](const PJ::PlotData::Point &a, const PJ::PlotData::Point &b) { return a.x < b.x; });
+            for (const PJ::PlotData::Point &point : pending)
+                process(point.x, point.y);
+
+            pending.clear();
+            pending.shrink_to_fit();
+        }
+
+        flush();
+        pyramid.flush([this](int level, double t, double v) { appendOverview(level, t, v); });
+    }
+
+    /**
+     * @brief Continues after the points already in the series, e.g. loaded before by an incremental reload
+     */
+    void resume() {
+        if (data == nullptr || data->size() == 0)
+            return;
+
+        pointCount = data->size();
+        sampleCount = pointCount;
+        hasSample = true;
+        lastSampleTime = data->back().x;
+    }
+
+    const std::string &name() const {
+        return data->plotName();
+    }
+
+    // Number of time resets before the current series, see setParts()
+    uint32_t currentPart() const {
+        return part;
+    }
+
+    // Number of samples read and points added to the series so far
+    uint64_t samples() const {
+        return sampleCount;
+    }
+
+    uint64_t points() const {
+        return pointCount;
+    }
+
+private:
+    PJ::PlotData *data;
+    DartlogDecimator decimator;
+    bool changesOnly;
+
+    DartlogPyramid pyramid;
+    std::vector<PJ::PlotData *> overviews;
+
+    bool hasLastValue;
+    bool holding;
+    double lastTime;
+    double lastValue;
+
+    uint64_t sampleCount;
+    uint64_t pointCount;
+
+    uint32_t part;
+    std::function<DartlogSeries(uint32_t)> partFactory;
+    std::function<void(DartlogSeries &)> partFinisher;
+
+    bool sortSamples;
+    bool sorting;
+    bool hasSample;
+    double lastSampleTime;
+    std::vector<PJ::PlotData::Point> pending;
+
+    void process(double time, double value) {
+        if (pyramid.enabled())
+            pyramid.add(time, value, [this](int level, double t, double v) { appendOverview(level, t, v); });
+
+        // Step-hold: a repeated value is only remembered, it is added as edge point before the next change
+        if (changesOnly && hasLastValue && (value == lastValue || (value != value && lastValue != lastValue))) {
+            lastTime = time;
+            holding = true;
+            return;
+        }
+
+        if (holding) {
+            add(lastTime, lastValue);
+            holding = false;
+        }
+
+        add(time, value);
+        lastValue = value;
+        hasLastValue = true;
+    }
+
+    // Adds the points held back by step-hold and decimation
+    void flush() {
+        if (holding) {
+            add(lastTime, lastValue);
+            holding = false;
+        }
+        decimator.flush([this](double t, double v) { append(t, v); });
+    }
+
+    /**
+     * @brief Takes back the points added so far, to sort them together with all later samples
+     *
+     * Decimated and step-hold points pass both filters unchanged again. The overview series are
+     * rebuilt from the sorted points.
+     */
+    void startSorting() {
+        flush();
+        sorting = true;
+
+        pending.reserve(data->size());
+        for (size_t i = 0; i < data->size(); i++)
+            pending.push_back(data->at(i));
+        data->clear();
+        pointCount = 0;
+        hasLastValue = false;
+
+        for (PJ::PlotData *overview : overviews)
+            overview->clear();
+        pyramid = DartlogPyramid((int) overviews.size());
+    }
+
+    // Whether the times of the column continue after the last sample without going backwards
+    bool inOrder(const DartlogStaging::Column &column, const std::vector<double> &times, double timeOffset) const {
+        if (!sortSamples)
+            return true;
+
+        uint32_t last = column.timeIndices[0];
+        if (hasSample && times[last] + timeOffset < lastSampleTime)
+            return false;
+
+        for (uint32_t index : column.timeIndices) {
+            if (times[index] < times[last])
+                return false;
+            last = index;
+        }
+        return true;
+    }
+
+    void add(double time, double value) {
+        if (decimator.enabled())
+            decimator.add(time, value, [this](double t, double v) { append(t, v); });
+        else
+            append(time, value);
+    }
+
+    void append(double time, double value) {
+        data->pushBack(PJ::PlotData::Point(time, value));
+        pointCount++;
+    }
+
+    void appendOverview(int level, double time, double value) {
+        overviews[level]->pushBack(PJ::PlotData::Point(time, value));
+    }
+};
@@ -0,0 +1,474 @@
+#include "dartlog_shm.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free
+              && std::atomic<float>::is_always_lock_free, "Atomics in shared memory must be lock-free");
+
+static size_t roundToPages(size_t size) {
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    return (size + page - 1) / page * page;
+}
+
+DartlogShmRing::DartlogShmRing()
+    : header(nullptr), ring(nullptr), base(nullptr), headerSize(0), mappedSize(0), ringSize(0), pending(0),
+      pendingDefinitions(0), inode(0), mapFd(-1), reader(false) {
+}
+
+DartlogShmRing::~DartlogShmRing() {
+    close();
+}
+
+/**
+ * @brief Creates a new ring for a producer, replacing any ring of the same name
+ *
+ * Readers of a replaced ring keep their mapping until they attach again, see isReplaced().
+ * @param name Name of the shared memory object, e.g. "/dartlog"
+ * @param capacity Size of the ring in bytes, rounded up to whole pages
+ */
+bool DartlogShmRing::create(const QString& name, qint64 capacity) {
+    close();
+
+    QByteArray shmName = name.toLocal8Bit();
+    shm_unlink(shmName.constData());
+    int fd = shm_open(shmName.constData(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        error = QString("Could not create shared memory %1: %2").arg(name).arg(strerror(errno));
+        return false;
+    }
+
+    uint64_t ringCapacity = roundToPages((size_t) capacity);
+    headerSize = roundToPages(sizeof(DartlogShmHeader));
+    if (ftruncate(fd, (off_t) (headerSize + ringCapacity)) != 0) {
+        error = QString("Could not size shared memory %1: %2").arg(name).arg(strerror(errno));
+        ::close(fd);
+        shm_unlink(shmName.constData());
+        return false;
+    }
+
+    bool mapped = map(fd);
+    ::close(fd);
+    if (!mapped || !mapRing(ringCapacity)) {
+        close();
+        shm_unlink(shmName.constData());
+        return false;
+    }
+
+    // The new object is zeroed, the magic marks it as ready for readers
+    header->capacity = ringCapacity;
+    header->layout = DARTLOG_SHM_LAYOUT;
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = DARTLOG_SHM_MAGIC;
+    pending = 0;
+    pendingDefinitions = 0;
+    return true;
+}
+
+/**
+ * @brief Attaches a reader to the ring of a producer
+ * @return @c false if there is no ring of this name (yet)
+ */
+bool DartlogShmRing::attach(const QString& name) {
+    close();
+
+    int fd = shm_open(name.toLocal8Bit().constData(), O_RDWR, 0);
+    if (fd < 0) {
+        error = QString("Could not open shared memory %1: %2").arg(name).arg(strerror(errno));
+        return false;
+    }
+
+    // The header gives the size of the ring
+    headerSize = roundToPages(sizeof(DartlogShmHeader));
+    bool mapped = map(fd);
+    ::close(fd);
+    if (!mapped)
+        return false;
+
+    if (header->magic != DARTLOG_SHM_MAGIC || header->layout != DARTLOG_SHM_LAYOUT) {
+        error = QString("%1 is not a DARTLOG ring").arg(name);
+        close();
+        return false;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+
+    if (!mapRing(header->capacity)) {
+        close();
+        return false;
+    }
+    reader = true;
+    return true;
+}
+
+/**
+ * @brief Maps the header of the shared memory object, the ring is mapped by mapRing()
+ */
+bool DartlogShmRing::map(int fd) {
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t) info.st_size < headerSize) {
+        error = "Shared memory too small for a DARTLOG ring";
+        return false;
+    }
+    inode = (uint64_t) info.st_ino;
+
+    void* mapping = mmap(nullptr, (size_t) info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+        error = QString("Could not map shared memory: %1").arg(strerror(errno));
+        return false;
+    }
+
+    // Kept open to map the ring twice, see mapRing()
+    base = (char*) mapping;
+    mappedSize = (size_t) info.st_size;
+    header = (DartlogShmHeader*) base;
+    mapFd = dup(fd);
+    return true;
+}
+
+/**
+ * @brief Maps the ring twice in a row behind the header, so ranges wrapping around its end are contiguous
+ */
+bool DartlogShmRing::mapRing(uint64_t capacity) {
+    if (mappedSize != headerSize + capacity) {
+        error = "Shared memory size does not match the ring";
+        return false;
+    }
+
+    // Reserve the whole range first, then place both views of the object in it
+    size_t total = headerSize + 2 * capacity;
+    char* reserved = (char*) mmap(nullptr, total, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reserved == MAP_FAILED) {
+        error = QString("Could not map shared memory: %1").arg(strerror(errno));
+        return false;
+    }
+
+    if (mmap(reserved, headerSize + capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, mapFd, 0) == MAP_FAILED
+        || mmap(reserved + headerSize + capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, mapFd,
+                (off_t) headerSize) == MAP_FAILED) {
+        error = QString("Could not map shared memory: %1").arg(strerror(errno));
+        munmap(reserved, total);
+        return false;
+    }
+
+    munmap(base, mappedSize);
+    ::close(mapFd);
+    mapFd = -1;
+
+    base = reserved;
+    mappedSize = total;
+    header = (DartlogShmHeader*) base;
+    ring = base + headerSize;
+    ringSize = capacity;
+    return true;
+}
+
+void DartlogShmRing::close() {
+    // A producer must not wait for a reader that is gone
+    if (reader && header != nullptr)
+        header->readerAttached.store(0, std::memory_order_release);
+
+    if (base != nullptr)
+        munmap(base, mappedSize);
+    if (mapFd >= 0)
+        ::close(mapFd);
+
+    header = nullptr;
+    ring = nullptr;
+    base = nullptr;
+    mappedSize = 0;
+    ringSize = 0;
+    pending = 0;
+    pendingDefinitions = 0;
+    inode = 0;
+    mapFd = -1;
+    reader = false;
+}
+
+bool DartlogShmRing::isOpen() const {
+    return ring != nullptr;
+}
+
+QString DartlogShmRing::errorString() const {
+    return error;
+}
+
+qint64 DartlogShmRing::capacity() const {
+    return (qint64) ringSize;
+}
+
+/**
+ * @brief Checks if a producer replaced the ring by a new one of the same name, e.g. after a restart
+ */
+bool DartlogShmRing::isReplaced(const QString& name) const {
+    int fd = shm_open(name.toLocal8Bit().constData(), O_RDONLY, 0);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    bool replaced = fstat(fd, &info) == 0 && (uint64_t) info.st_ino != inode;
+    ::close(fd);
+    return replaced;
+}
+
+/**
+ * @brief Appends bytes of the stream, to be published by publish() once a record is complete
+ *
+ * An attached reader is waited for to make room, for at most DARTLOG_SHM_WAIT_MS; it is then detached
+ * and its data overwritten, so a stuck reader never stalls the producer for long.
+ * @param definition @c true for the header string and tag definitions, which are also kept for readers attaching later
+ */
+bool DartlogShmRing::write(const char* data, qint64 size, bool definition) {
+    if ((uint64_t) size > ringSize) {
+        error = "Record larger than the ring";
+        return false;
+    }
+
+    if (header->readerAttached.load(std::memory_order_acquire)) {
+        auto start = std::chrono::steady_clock::now();
+        while (pending + size - header->readPos.load(std::memory_order_acquire) > ringSize) {
+            if (std::chrono::steady_clock::now() - start > std::chrono::milliseconds(DARTLOG_SHM_WAIT_MS)) {
+                header->readerAttached.store(0, std::memory_order_release);
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(DARTLOG_SHM_POLL_US));
+        }
+    }
+
+    // Nothing is written if the definitions are full, so the ring stays in step with them
+    if (definition && pendingDefinitions + size > DARTLOG_SHM_DEFINITIONS_SIZE) {
+        error = "Too many tag definitions for the ring";
+        return false;
+    }
+
+    // Contiguous even across the end of the ring, see mapRing()
+    memcpy(ring + pending % ringSize, data, size);
+    pending += size;
+
+    if (definition) {
+        // Published together with the position, see publish()
+        memcpy(header->definitions + pendingDefinitions, data, size);
+        pendingDefinitions += (uint32_t) size;
+    }
+    return true;
+}
+
+/**
+ * @brief Publishes the bytes written so far, which must end at a record boundary
+ * @param lastID ID of the last record, @c 0 for a tag definition
+ * @param time Time at the boundary, valid if @p hasTime
+ */
+void DartlogShmRing::publish(uint16_t lastID, float time, bool hasTime) {
+    uint32_t sequence = header->sequence.load(std::memory_order_relaxed);
+    header->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    header->lastID.store(lastID, std::memory_order_relaxed);
+    header->time.store(time, std::memory_order_relaxed);
+    header->hasTime.store(hasTime ? 1 : 0, std::memory_order_relaxed);
+    header->definitionsSize.store(pendingDefinitions, std::memory_order_relaxed);
+    header->writePos.store(pending, std::memory_order_release);
+
+    header->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+// Marks the end of the stream
+void DartlogShmRing::finish() {
+    header->finished.store(1, std::memory_order_release);
+}
+
+/**
+ * @brief Reads the published position with the parser state and the definitions there, consistent with each other
+ */
+DartlogShmRing::Snapshot DartlogShmRing::snapshot() const {
+    Snapshot snapshot;
+    while (true) {
+        uint32_t sequence = header->sequence.load(std::memory_order_acquire);
+        if (sequence & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        snapshot.pos = header->writePos.load(std::memory_order_acquire);
+        snapshot.lastID = (uint16_t) header->lastID.load(std::memory_order_relaxed);
+        snapshot.time = header->time.load(std::memory_order_relaxed);
+        snapshot.hasTime = header->hasTime.load(std::memory_order_relaxed) != 0;
+        snapshot.definitionsSize = header->definitionsSize.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header->sequence.load(std::memory_order_relaxed) == sequence)
+            return snapshot;
+    }
+}
+
+// Header string and all tag definitions before the position of the snapshot
+QByteArray DartlogShmRing::definitions(const Snapshot& snapshot) const {
+    uint32_t size = qMin<uint32_t>(snapshot.definitionsSize, DARTLOG_SHM_DEFINITIONS_SIZE);
+    return QByteArray(header->definitions, (int) size);
+}
+
+bool DartlogShmRing::isFinished() const {
+    return header->finished.load(std::memory_order_acquire) != 0;
+}
+
+// Stream bytes published so far
+uint64_t DartlogShmRing::published() const {
+    return header->writePos.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief The stream from the given position on, valid for up to capacity() bytes
+ */
+const char* DartlogShmRing::range(uint64_t pos) const {
+    return ring + pos % ringSize;
+}
+
+/**
+ * @brief Makes the producer wait for this reader from the given position on
+ */
+void DartlogShmRing::attachReader(uint64_t pos) {
+    header->readPos.store(pos, std::memory_order_release);
+    header->readerAttached.store(1, std::memory_order_release);
+}
+
+/**
+ * @brief Releases the stream up to the given position to the producer
+ * @return @c false if the producer stopped waiting for this reader, data read since the last call may be overwritten
+ */
+bool DartlogShmRing::consumed(uint64_t pos) {
+    header->readPos.store(pos, std::memory_order_release);
+    return header->readerAttached.load(std::memory_order_acquire) != 0;
+}
+
+DartlogShmReader::DartlogShmReader(DartlogShmRing& ring)
+    : ring(ring), parser(input), readPos(0), synced(false), droppedBytes(0) {
+}
+
+/**
+ * @brief Decodes all records published since the last call
+ *
+ * Values are decoded in place from the ring into @p staging, keyed by tag ID. A batch ends early
+ * before the redefinition of a tag with staged values, as its type may change: the staged values
+ * still belong to the series of the old definition, which is read by the next call.
+ * @param newTags Receives the tag definitions read, all of them after (re)starting at the published position
+ * @return @c true if values or tags were read
+ */
+bool DartlogShmReader::poll(DartlogStaging& staging, std::vector<DartlogTag>& newTags) {
+    if (!synced && !sync(newTags))
+        return false;
+
+    uint64_t end = ring.published();
+    if (end - readPos > (uint64_t) ring.capacity()) {
+        // Fell behind by more than the ring, continue at the published position
+        synced = false;
+        return !newTags.empty();
+    }
+    if (end == readPos)
+        return !newTags.empty();
+
+    input.openBuffer(ring.range(readPos), (qint64) (end - readPos));
+
+    // Definitions of a dropped batch are read again by sync()
+    size_t tagsBefore = newTags.size();
+    qint64 batchLength = -1;
+    bool failed = false;
+    dartlogDispatchVersion(parser.version(), [&](auto version) {
+        constexpr int Version = decltype(version)::value;
+
+        while (true) {
+            qint64 recordStart = input.getPos();
+            DartlogParser::Record record = parser.next<Version>();
+            if (record == DartlogParser::End)
+                break;
+
+            if (record == DartlogParser::Error) {
+                error = parser.errorString();
+                failed = true;
+                break;
+            }
+
+            if (record == DartlogParser::TagDefinition) {
+                if (staging.column(parser.tag().index) != nullptr) {
+                    batchLength = recordStart;
+                    break;
+                }
+                newTags.push_back(parser.tag());
+                continue;
+            }
+
+            staging.add(parser.valueID(), parser.valueType(), parser.rawValue(), parser.time());
+        }
+    });
+
+    uint64_t batchEnd = readPos + (uint64_t) (batchLength >= 0 ? batchLength : input.getPos());
+    input.close();
+
+    // Values of a broken stream or overwritten while decoding can not be trusted
+    if (!ring.consumed(batchEnd) || failed) {
+        staging.clear();
+        newTags.resize(tagsBefore);
+        synced = false;
+        return !newTags.empty();
+    }
+
+    readPos = batchEnd;
+    return true;
+}
+
+/**
+ * @brief Starts reading at the published position, with the tag table of all definitions so far
+ */
+bool DartlogShmReader::sync(std::vector<DartlogTag>& newTags) {
+    DartlogShmRing::Snapshot snapshot = ring.snapshot();
+
+    // Definitions are published together with the position, so they cover everything up to it
+    definitions = ring.definitions(snapshot);
+    if (definitions.isEmpty())
+        return false;
+
+    input.openBuffer(definitions.constData(), definitions.size());
+    parser.setState(DartlogParserState());
+    if (!parser.readHeader() || parser.version() >= 3) {
+        error = "Not a DARTLOG or DARTLOG2 stream";
+        return false;
+    }
+
+    while (true) {
+        DartlogParser::Record record = parser.next();
+        if (record == DartlogParser::End)
+            break;
+        if (record != DartlogParser::TagDefinition) {
+            error = "Broken tag definitions in the ring";
+            return false;
+        }
+        newTags.push_back(parser.tag());
+    }
+    input.close();
+
+    DartlogParserState state = parser.state();
+    state.lastID = snapshot.lastID;
+    state.time = snapshot.time;
+    state.hasTime = snapshot.hasTime;
+    parser.setState(state);
+
+    if (readPos > 0 && snapshot.pos > readPos)
+        droppedBytes += snapshot.pos - readPos;
+    readPos = snapshot.pos;
+    ring.attachReader(readPos);
+    synced = true;
+    return true;
+}
+
+QString DartlogShmReader::errorString() const {
+    return error;
+}
+
+uint64_t DartlogShmReader::dropped() const {
+    return droppedBytes;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "dartlog_input.h"
+#include "dartlog_parser.h"
+#include "dartlog_staging.h"
+
+/*
+ * Shared memory ring of a DARTLOG/DARTLOG2 stream (POSIX shm, /dev/shm/<name>)
+ *
+ *   header          DartlogShmHeader, padded to whole pages
+ *   ring            capacity bytes of the stream, mapped twice in a row so every range of up to
+ *                   capacity bytes is contiguous and records are decoded in place
+ *
+ * The stream is the byte stream of a log file: the header string, then records. The producer
+ * publishes the stream position only at record boundaries, together with the parser state there,
+ * and keeps the header string and all tag definitions in the header. So a reader can start at any
+ * published position, e.g. when attaching late or after falling behind by more than the ring.
+ * A restarted producer replaces the ring by a new object of the same name.
+ */
+
+#define DARTLOG_SHM_DEFAULT_NAME "/dartlog"
+#define DARTLOG_SHM_DEFAULT_CAPACITY (64 * 1024 * 1024)
+#define DARTLOG_SHM_MAGIC 0x4D48534C
+#define DARTLOG_SHM_LAYOUT 2
+// Room for the header string and all tag definitions of the stream
+#define DARTLOG_SHM_DEFINITIONS_SIZE (1024 * 1024)
+// Longest wait of the producer for a reader to make room, the reader is then considered gone
+#define DARTLOG_SHM_WAIT_MS 1000
+// Sleep of a waiting reader or producer between polls
+#define DARTLOG_SHM_POLL_US 100
+
+struct DartlogShmHeader {
+    uint32_t magic;
+    uint32_t layout;
+    uint64_t capacity;
+    std::atomic<uint32_t> finished;
+
+    // Stream bytes published, always a record boundary, with the parser state there (seqlock: odd while written)
+    alignas(64) std::atomic<uint32_t> sequence;
+    std::atomic<uint64_t> writePos;
+    std::atomic<uint32_t> lastID;
+    std::atomic<float> time;
+    std::atomic<uint32_t> hasTime;
+    // Bytes of the definitions below written before the published position
+    std::atomic<uint32_t> definitionsSize;
+
+    // Stream bytes consumed by the attached reader, if any
+    alignas(64) std::atomic<uint64_t> readPos;
+    std::atomic<uint32_t> readerAttached;
+
+    // Header string and tag definitions of the stream, in stream order
+    alignas(64) char definitions[DARTLOG_SHM_DEFINITIONS_SIZE];
+};
+
+/**
+ * @brief Mapping of a shared memory ring, created by the producer or attached to by a reader
+ */
+class DartlogShmRing {
+public:
+    // Published position of the stream and the parser state there
+    struct Snapshot {
+        uint64_t pos = 0;
+        uint16_t lastID = 0;
+        float time = 0;
+        bool hasTime = false;
+        uint32_t definitionsSize = 0;
+    };
+
+    DartlogShmRing();
+    ~DartlogShmRing();
+
+    bool create(const QString& name, qint64 capacity);
+    bool attach(const QString& name);
+    void close();
+
+    bool isOpen() const;
+    QString errorString() const;
+    qint64 capacity() const;
+    bool isReplaced(const QString& name) const;
+
+    // Producer
+    bool write(const char* data, qint64 size, bool definition);
+    void publish(uint16_t lastID, float time, bool hasTime);
+    void finish();
+
+    // Reader
+    Snapshot snapshot() const;
+    QByteArray definitions(const Snapshot& snapshot) const;
+    bool isFinished() const;
+    uint64_t published() const;
+    const char* range(uint64_t pos) const;
+    void attachReader(uint64_t pos);
+    bool consumed(uint64_t pos);
+
+private:
+    DartlogShmHeader* header;
+    char* ring;
+    char* base;
+    size_t headerSize;
+    size_t mappedSize;
+    uint64_t ringSize;
+    // Stream bytes written by the producer, published or not
+    uint64_t pending;
+    uint32_t pendingDefinitions;
+    // Identifies the shared memory object, see isReplaced()
+    uint64_t inode;
+    int mapFd;
+    bool reader;
+    QString error;
+
+    bool map(int fd);
+    bool mapRing(uint64_t capacity);
+};
+
+/**
+ * @brief Decodes the records published to a ring in place, a batch at a time
+ */
+class DartlogShmReader {
+public:
+    explicit DartlogShmReader(DartlogShmRing& ring);
+
+    bool poll(DartlogStaging& staging, std::vector<DartlogTag>& newTags);
+
+    QString errorString() const;
+    // Stream bytes skipped because the reader fell behind by more than the ring
+    uint64_t dropped() const;
+
+private:
+    DartlogShmRing& ring;
+    DartlogInput input;
+    DartlogParser parser;
+    QByteArray definitions;
+    uint64_t readPos;
+    bool synced;
+    uint64_t droppedBytes;
+    QString error;
+
+    bool sync(std::vector<DartlogTag>& newTags);
+};
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "dartlog_format.h"
+
+/**
+ * @brief Values of a part of a log, staged in columns: reading a value only copies its raw bytes and
+ * the index of its time, each column is then converted to double at once
+ *
+ * The conversion is a plain loop per type over contiguous values, which the compiler vectorizes.
+ */
+class DartlogStaging {
+public:
+    struct Column {
+        uint8_t type = 0;
+        // Index into times() of every value
+        std::vector<uint32_t> timeIndices;
+        // Raw bytes of every value in a slot of 8 bytes, converted to double in place by convert()
+        std::vector<double> values;
+        bool converted = false;
+    };
+
+    DartlogStaging() : count(0) {
+    }
+
+    /**
+     * @brief Removes all values, keeping the capacity of the columns for the next values
+     */
+    void clear() {
+        for (uint32_t key : keyList) {
+            Column &column = columnList[key];
+            column.timeIndices.clear();
+            column.values.clear();
+            column.converted = false;
+        }
+        keyList.clear();
+        timeList.clear();
+        count = 0;
+    }
+
+    // Number of values staged
+    size_t size() const {
+        return count;
+    }
+
+    /**
+     * @brief Stages a value
+     * @param key Column of the value, e.g. its tag ID; columns are kept in an array indexed by the key
+     */
+    void add(uint32_t key, uint8_t type, const char *raw, double time) {
+        // Times are stored once for all values of a record burst
+        if (timeList.empty() || timeList.back() != time)
+            timeList.push_back(time);
+
+        if (key >= columnList.size())
+            columnList.resize(std::max<size_t>(key + 1, UINT8_MAX + 1));
+
+        Column &column = columnList[key];
+        if (column.timeIndices.empty())
+            keyList.push_back(key);
+        column.type = type;
+
+        column.values.push_back(0);
+        memcpy(&column.values.back(), raw, dartlogTypeSize(type));
+        column.timeIndices.push_back((uint32_t) (timeList.size() - 1));
+        count++;
+    }
+
+    /**
+     * @brief Converts the raw values of all columns to double
+     */
+    void convert() {
+        for (uint32_t key : keyList)
+            convertColumn(columnList[key]);
+    }
+
+    // Keys with staged values, in the order of their first value
+    const std::vector<uint32_t> &keys() const {
+        return keyList;
+    }
+
+    // @c nullptr if no value was staged for the key
+    const Column *column(uint32_t key) const {
+        if (key >= columnList.size() || columnList[key].timeIndices.empty())
+            return nullptr;
+        return &columnList[key];
+    }
+
+    const std::vector<double> &times() const {
+        return timeList;
+    }
+
+private:
+    std::vector<Column> columnList;
+    std::vector<uint32_t> keyList;
+    std::vector<double> timeList;
+    size_t count;
+
+    template <typename T>
+    static void convertValues(double *values, size_t count) {
+        for (size_t i = 0; i < count; i++) {
+            T v;
+            memcpy(&v, &values[i], sizeof(T));
+            values[i] = (double) v;
+        }
+    }
+
+    static void convertColumn(Column &column) {
+        if (column.converted)
+            return;
+        column.converted = true;
+
+        size_t count = column.values.size();
+        double *values = column.values.data();
+
+        switch (column.type) {
+            case DARTLOG_TYPE_UINT8: convertValues<uint8_t>(values, count); break;
+            case DARTLOG_TYPE_UINT16: convertValues<uint16_t>(values, count); break;
+            case DARTLOG_TYPE_UINT32: convertValues<uint32_t>(values, count); break;
+            case DARTLOG_TYPE_INT8: convertValues<int8_t>(values, count); break;
+            case DARTLOG_TYPE_INT16: convertValues<int16_t>(values, count); break;
+            case DARTLOG_TYPE_INT32: convertValues<int32_t>(values, count); break;
+            case DARTLOG_TYPE_FLOAT: convertValues<float>(values, count); break;
+            case DARTLOG_TYPE_DOUBLE: convertValues<double>(values, count); break;
+            case DARTLOG_TYPE_UINT64: convertValues<uint64_t>(values, count); break;
+            case DARTLOG_TYPE_INT64: convertValues<int64_t>(values, count); break;
+        }
+    }
+};
@@ -0,0 +1,288 @@
+#include "dartlog_writer.h"
+
+#include <QSaveFile>
+#include <array>
+#include <thread>
+#include <unordered_map>
+
+#include "dartlog_input.h"
+#include "dartlog_parser.h"
+#include "qcompressor.h"
+
+namespace {
+
+template <typename T>
+void put(QByteArray& out, T v) {
+    out.append((const char*) &v, sizeof(v));
+}
+
+void putString(QByteArray& out, const std::string& str) {
+    out.append(str.c_str(), (int) str.size() + 1);
+}
+
+}
+
+DartlogWriter::DartlogWriter(QIODevice* device, bool compress, int level)
+    : device(device), compress(compress), level(level), lastID(0), types(65536, 0) {
+}
+
+bool DartlogWriter::begin() {
+    pending.append(DARTLOG2_HEADER, sizeof(DARTLOG2_HEADER));
+    return true;
+}
+
+/**
+ * @brief Writes the definition of a tag, the values of the tag are then written with its index as ID
+ */
+bool DartlogWriter::writeTag(const DartlogTag& tag) {
+    if (tag.index == 0 || !dartlogIsValidType(tag.type) || tag.name.empty()) {
+        error = "Invalid tag definition: " + QString::fromStdString(tag.name);
+        return false;
+    }
+
+    types[tag.index] = tag.type;
+
+    writeID(0);
+    put<uint16_t>(pending, tag.index);
+    put<uint8_t>(pending, tag.type);
+    putString(pending, tag.name);
+
+    if (!tag.unit.empty()) {
+        // The attribute length is a single byte
+        std::string unit = tag.unit.substr(0, 254);
+        put<uint8_t>(pending, DARTLOG_ATTRIBUTE_UNIT);
+        put<uint8_t>(pending, (uint8_t) (unit.size() + 1));
+        putString(pending, unit);
+    }
+    if (tag.verbose) {
+        put<uint8_t>(pending, DARTLOG_ATTRIBUTE_VERBOSE);
+        put<uint8_t>(pending, 1);
+        put<uint8_t>(pending, 1);
+    }
+    put<uint8_t>(pending, DARTLOG_ATTRIBUTE_END);
+
+    return flush(false);
+}
+
+/**
+ * @brief Writes a value of a defined tag
+ * @param rawValue The value in the native type of the tag
+ */
+bool DartlogWriter::writeValue(uint16_t id, const char* rawValue) {
+    uint8_t type = types[id];
+    if (type == 0) {
+        error = QString("Value of undefined tag %1 written").arg((int) id);
+        return false;
+    }
+
+    writeID(id);
+    pending.append(rawValue, (int) dartlogTypeSize(type));
+
+    if (pending.size() < DARTLOG_WRITER_BUFFER_SIZE)
+        return true;
+    return flush(false);
+}
+
+bool DartlogWriter::finish() {
+    return flush(true);
+}
+
+QString DartlogWriter::errorString() const {
+    return error;
+}
+
+void DartlogWriter::writeID(uint16_t id) {
+    // Use the shortest escape, exactly as the reader resolves it
+    if (id != 0 && id == (uint16_t) (lastID + 1))
+        put<uint8_t>(pending, DARTLOG_ID_NEXT);
+    else if (id < DARTLOG_ID_NEXT)
+        put<uint8_t>(pending, (uint8_t) id);
+    else {
+        put<uint8_t>(pending, DARTLOG_ID_LONG);
+        put<uint16_t>(pending, id);
+    }
+
+    lastID = id;
+}
+
+/**
+ * @brief Writes the pending data, compressing a batch of full members at once on all cores
+ * @param final Also writes the last partial member
+ */
+bool DartlogWriter::flush(bool final) {
+    QByteArray data;
+
+    if (compress) {
+        int threadCount = qMax(1, (int) std::thread::hardware_concurrency());
+        int batchSize = DARTLOG_WRITER_MEMBER_SIZE * threadCount;
+        int size = final ? pending.size() : (pending.size() / batchSize) * batchSize;
+        if (size == 0)
+            return true;
+
+        if (!QCompressor::gzipCompressMembers(pending.left(size), data, DARTLOG_WRITER_MEMBER_SIZE, level)) {
+            error = "Could not compress data";
+            return false;
+        }
+        pending = pending.mid(size);
+    }
+    else {
+        if (!final && pending.size() < DARTLOG_WRITER_BUFFER_SIZE)
+            return true;
+
+        data = pending;
+        pending.clear();
+    }
+
+    if (device->write(data) != data.size()) {
+        error = "Could not write file: " + device->errorString();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Checks a tag name against a list of names, where a trailing '*' matches any suffix
+ */
+bool dartlogTagMatches(const std::vector<std::string>& patterns, const std::string& name) {
+    if (patterns.empty())
+        return true;
+
+    for (const std::string& pattern : patterns) {
+        if (!pattern.empty() && pattern.back() == '*') {
+            if (name.compare(0, pattern.size() - 1, pattern, 0, pattern.size() - 1) == 0)
+                return true;
+        }
+        else if (name == pattern)
+            return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Writes the selected tags of a log within a time range into a new DARTLOG2 log
+ *
+ * The "time" tag is always exported. Tags are renumbered in order of their definition, so small
+ * subsets only need single byte IDs. Each selected tag starts with its last value before the
+ * time range, so slowly changing signals are not lost by the cut.
+ * @param progress Called periodically with the input position and size, returning @c false cancels the export
+ */
+bool exportDartlogSubset(const QString& inputFilename, const QString& outputFilename, const DartlogExportOptions& options,
+                         QString& error, const std::function<bool(qint64, qint64)>& progress) {
+    DartlogInput input;
+    if (!input.open(inputFilename, nullptr)) {
+        error = input.errorString();
+        return false;
+    }
+
+    DartlogParser parser(input);
+    if (!parser.readHeader() || parser.version() >= 3) {
+        error = "Not a DARTLOG or DARTLOG2 file: header missing.";
+        return false;
+    }
+
+    QSaveFile output(outputFilename);
+    if (!output.open(QIODevice::WriteOnly)) {
+        error = "Could not open output file: " + output.errorString();
+        return false;
+    }
+
+    DartlogWriter writer(&output, options.compress, options.level);
+    if (!writer.begin()) {
+        error = writer.errorString();
+        return false;
+    }
+
+    std::unordered_map<uint16_t, uint16_t> outputIDs;
+    std::unordered_map<uint16_t, std::array<char, 8>> lastValues;
+    uint32_t nextID = 1;
+    bool inRange = false;
+    bool complete = true;
+    uint64_t counter = 0;
+
+    while (true) {
+        if (progress && counter % (1024 * 32) == 0 && !progress(input.getPos(), input.getSize())) {
+            error = "Export canceled";
+            output.cancelWriting();
+            return false;
+        }
+        counter++;
+
+        DartlogParser::Record record = parser.next();
+
+        if (record == DartlogParser::End)
+            break;
+
+        if (record == DartlogParser::Error) {
+            // Keep everything read so far, as the plugin does
+            error = parser.errorString() + ": exported data up to the error";
+            complete = false;
+            break;
+        }
+
+        if (record == DartlogParser::TagDefinition) {
+            DartlogTag tag = parser.tag();
+
+            if (tag.name != "time" && !dartlogTagMatches(options.tags, tag.name)) {
+                outputIDs[tag.index] = 0;
+                continue;
+            }
+
+            uint16_t& id = outputIDs[tag.index];
+            if (id == 0) {
+                if (nextID > 0xFFFF) {
+                    error = "Too many tags to export";
+                    return false;
+                }
+                id = (uint16_t) nextID++;
+            }
+
+            tag.index = id;
+            lastValues.erase(id);
+            if (!writer.writeTag(tag)) {
+                error = writer.errorString();
+                return false;
+            }
+            continue;
+        }
+
+        uint16_t id = outputIDs[parser.valueID()];
+        if (id == 0)
+            continue;
+
+        double time = parser.time();
+        if (time < options.timeStart || time > options.timeEnd) {
+            inRange = false;
+            memcpy(lastValues[id].data(), parser.rawValue(), dartlogTypeSize(parser.valueType()));
+            continue;
+        }
+
+        if (!writer.writeValue(id, parser.rawValue())) {
+            error = writer.errorString();
+            return false;
+        }
+
+        if (!inRange) {
+            // Entering the time range: repeat the last values of all other tags at the current time
+            inRange = true;
+            for (const auto& lastValue : lastValues) {
+                if (lastValue.first != id && !writer.writeValue(lastValue.first, lastValue.second.data())) {
+                    error = writer.errorString();
+                    return false;
+                }
+            }
+            lastValues.clear();
+        }
+    }
+
+    if (input.hasStreamError() || !input.warningString().isEmpty()) {
+        error = "Could not fully decompress file: data may be incomplete";
+        complete = false;
+    }
+
+    if (!writer.finish() || !output.commit()) {
+        error = writer.errorString().isEmpty() ? output.errorString() : writer.errorString();
+        return false;
+    }
+
+    return complete;
+}
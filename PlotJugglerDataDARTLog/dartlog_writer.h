@@ -0,0 +1,55 @@
+#pragma once
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QString>
+#include <cfloat>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "dartlog_format.h"
+
+#define DARTLOG_WRITER_MEMBER_SIZE (1024 * 1024)
+#define DARTLOG_WRITER_BUFFER_SIZE (1024 * 1024)
+
+/**
+ * @brief Writes a DARTLOG2 log record by record, optionally as a multi-member GZIP file compressed on all cores
+ */
+class DartlogWriter {
+public:
+    explicit DartlogWriter(QIODevice* device, bool compress = true, int level = -1);
+
+    bool begin();
+    bool writeTag(const DartlogTag& tag);
+    bool writeValue(uint16_t id, const char* rawValue);
+    bool finish();
+
+    QString errorString() const;
+
+private:
+    QIODevice* device;
+    bool compress;
+    int level;
+    QByteArray pending;
+    uint16_t lastID;
+    std::vector<uint8_t> types;
+    QString error;
+
+    void writeID(uint16_t id);
+    bool flush(bool final);
+};
+
+struct DartlogExportOptions {
+    // Tag names as stored in the log, a trailing '*' matches any suffix. Empty exports all tags.
+    std::vector<std::string> tags;
+    double timeStart = -DBL_MAX;
+    double timeEnd = DBL_MAX;
+    bool compress = true;
+    int level = -1;
+};
+
+bool dartlogTagMatches(const std::vector<std::string>& patterns, const std::string& name);
+
+bool exportDartlogSubset(const QString& inputFilename, const QString& outputFilename, const DartlogExportOptions& options,
+                         QString& error, const std::function<bool(qint64, qint64)>& progress = nullptr);
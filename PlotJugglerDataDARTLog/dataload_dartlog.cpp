@@ -3,20 +3,73 @@
 #include <QMessageBox>
 #include <QDateTime>
 #include <QInputDialog>
+#include <QLineEdit>
 #include <qprogressdialog.h>
 #include <map>
+#include <memory>
+#include <thread>
+#include <unordered_set>
 #include <QFileInfo>
+#include <QFileDialog>
+#include <QDir>
 
-#include "qcompressor.h"
+#include "dartlog3.h"
+#include "dartlog_archive.h"
+#include "dartlog_export_dialog.h"
+#include "dartlog_writer.h"
+#include "dartlog_parallel.h"
+#include "dartlog_staging.h"
 
 // Supported by plotjuggler nativly now
 #define DISABLE_PREFIX_QUESTION 1
-#define REDUCE_PLOT 0
-#define ADD_EDGES_TO_PLOT 0
 
-DataLoadDARTLog::DataLoadDARTLog() {
+DataLoadDARTLog::DataLoadDARTLog()
+    : _time_window_start(-DBL_MAX), _time_window_end(DBL_MAX), _decimation_width(0), _changes_only(false), _overview(false), _time_reset(DartlogTimeReset::Sort), _incremental_reload(false), _last_time_min(0), _last_time_max(0) {
     _extensions.push_back("dat");
     _extensions.push_back("gz");
+    _extensions.push_back("lz4");
+    _extensions.push_back(DARTLOG_LIST_EXTENSION);
+    _extensions.push_back("zip");
+    _extensions.push_back("tar");
+    _extensions.push_back("tgz");
+
+    QAction *exportAction = new QAction("Export subset...", this);
+    connect(exportAction, &QAction::triggered, this, &DataLoadDARTLog::exportSubset);
+    _actions.push_back(exportAction);
+
+    QAction *fileListAction = new QAction("Create file list...", this);
+    connect(fileListAction, &QAction::triggered, this, &DataLoadDARTLog::createFileList);
+    _actions.push_back(fileListAction);
+
+    QAction *decimationAction = new QAction("Load decimation...", this);
+    connect(decimationAction, &QAction::triggered, this, &DataLoadDARTLog::configureDecimation);
+    _actions.push_back(decimationAction);
+
+    _changes_only_action = new QAction("Load changes only", this);
+    _changes_only_action->setCheckable(true);
+    connect(_changes_only_action, &QAction::toggled, this, [this](bool checked) { _changes_only = checked; });
+    _actions.push_back(_changes_only_action);
+
+    _overview_action = new QAction("Load overview series", this);
+    _overview_action->setCheckable(true);
+    connect(_overview_action, &QAction::toggled, this, [this](bool checked) { _overview = checked; });
+    _actions.push_back(_overview_action);
+
+    QAction *timeResetAction = new QAction("Time resets...", this);
+    connect(timeResetAction, &QAction::triggered, this, &DataLoadDARTLog::configureTimeReset);
+    _actions.push_back(timeResetAction);
+
+    // Off by default, as the copy of the series doubles the memory used
+    _incremental_reload_action = new QAction("Reload appended data only", this);
+    _incremental_reload_action->setCheckable(true);
+    connect(_incremental_reload_action, &QAction::toggled, this, [this](bool checked) { _incremental_reload = checked; });
+    _actions.push_back(_incremental_reload_action);
+}
+
+// Copies the points of all series, e.g. the series of a log kept for an incremental reload
+static void copySeries(const PlotDataMapRef &source, PlotDataMapRef &destination) {
+    for (const auto &it : source.numeric)
+        destination.addNumeric(it.first)->second.clonePoints(it.second);
 }
 
 const std::vector<const char *> &DataLoadDARTLog::compatibleFileExtensions() const {
@@ -24,10 +77,6 @@ const std::vector<const char *> &DataLoadDARTLog::compatibleFileExtensions() con
 }
 
 bool DataLoadDARTLog::readDataFromFile(FileLoadInfo *info, PlotDataMapRef &plot_data) {
-    QFile file(info->filename);
-    if (!file.open(QFile::ReadOnly))
-        return false;
-
     // Load file info
     QFileInfo fileInfo(info->filename);
 
@@ -43,401 +92,1430 @@ bool DataLoadDARTLog::readDataFromFile(FileLoadInfo *info, PlotDataMapRef &plot_
 
     QApplication::processEvents();
 
-    bool isGZip = info->filename.endsWith(".gz", Qt::CaseInsensitive);
-    if (isGZip) {
-        // Do not directly read file
-        inputFile = nullptr;
-        pos = 0;
+    if (info->plugin_config.hasChildNodes())
+        xmlLoadState(info->plugin_config.firstChildElement());
 
-        progress_dialog.setLabelText("Decompression... please wait");
-        QByteArray data = file.readAll();
-        if (data.size() == 0) {
-            QMessageBox::warning(nullptr, "Error reading file", "Could not read file");
-            return false;
-        }
-        file.close();
+    _last_filename.clear();
+    _last_tag_names.clear();
 
-        if (!QCompressor::gzipDecompress(data, inputData, &progress_dialog)) {
-            QMessageBox::warning(nullptr, "Warning reading file", "Could not fully decompress file: data may be incomplete or fully missing");
-        }
-    }
-    else {
-        // Directly read file
-        inputFile = &file;
+    bool singleLog = fileInfo.suffix().compare(DARTLOG_LIST_EXTENSION, Qt::CaseInsensitive) != 0 &&
+                     !DartlogArchive::isArchive(info->filename);
+    if (!singleLog) {
+        // Only single logs are continued on reload
+        _resume = DartlogResume();
+        _resume_data.clear();
     }
 
-    progress_dialog.setLabelText("Loading data... please wait");
-    progress_dialog.setValue(0);
-    progress_dialog.setRange(0, getSize());
-    QApplication::processEvents();
-
-    std::map<uint16_t, uint16_t> tags;
-    std::map<uint16_t, PlotData *> plots;
-    std::map<uint16_t, double> lastTime;
-    std::map<uint16_t, double> lastValue;
-    std::map<uint16_t, bool> isXY;
-    std::map<uint16_t, bool> isVerbose;
-    std::vector<uint16_t> tagIndices;
-    std::vector<std::string> tagNames;
-    uint16_t maxTagID = 0;
-    uint16_t timeTagID = 0;
-    float time = 0;
-
-    // Read header
-    std::string header = readString();
-    if (header != "DARTLOG" && header != "DARTLOG2") {
-        QMessageBox::warning(nullptr, "Error reading file", "Not a DARTLOG file: header missing.");
-        return false;
+    if (fileInfo.suffix().compare(DARTLOG_LIST_EXTENSION, Qt::CaseInsensitive) == 0) {
+        bool ok = loadFileList(info, plot_data, progress_dialog);
+        progress_dialog.close();
+        return ok;
     }
 
-    PlotData::Point dartLogVersion(0, 1);
-    if (header == "DARTLOG2")
-        dartLogVersion = PlotData::Point(0, 2);
-
-    bool isAtLeastDARTLOG2 = dartLogVersion.y >= 2;
+    if (DartlogArchive::isArchive(info->filename)) {
+        bool ok = loadArchive(info, plot_data, progress_dialog);
+        progress_dialog.close();
+        return ok;
+    }
 
 #if DISABLE_PREFIX_QUESTION
     bool usePrefix = false;
 #else
     bool usePrefix = QMessageBox::question(nullptr, "Load with prefix?", "Do you want to load the data with a prefix? If yes, you can load multiple data sets in the same PlotJuggler instance.", QMessageBox::Yes | QMessageBox::No) == QMessageBox::StandardButton::Yes;
 #endif
-    bool loadVerboseData = false;
-    uint64_t counter = 0;
-    uint16_t lastID = 0;
-
-    uint32_t verboseSignalsIgnoredCount = 0;
-
-    while (!atEnd()) {
-        // Update file progress dialog
-        if (counter % (1024 * 32) == 0) {
-            progress_dialog.setValue(getPos());
-            if (progress_dialog.wasCanceled())
-                break;
 
-            QApplication::processEvents();
+    auto makeJob = [&]() {
+        std::unique_ptr<LoadJob> job(new LoadJob());
+        job->filename = info->filename;
+        job->prefix = usePrefix ? fileInfo.baseName().toStdString() : "";
+        job->dialog = &progress_dialog;
+        return job;
+    };
+    std::unique_ptr<LoadJob> job = makeJob();
+    bool ok = false;
+
+    // Reloading a log only appended to continues from the series loaded before
+    bool resumed = canResume(info->filename);
+    if (resumed) {
+        copySeries(_resume_data, plot_data);
+        job->resume = &_resume;
+        job->tagNames = _resume.tagNames;
+        job->timeMin = _resume.timeMin;
+        job->timeMax = _resume.timeMax;
+        job->verboseSignalsIgnoredCount = _resume.verboseSignalsIgnoredCount;
+
+        ok = loadFile(*job, info, plot_data);
+        if (!ok) {
+            // E.g. the log was replaced in the meantime, load it again from the start
+            plot_data.clear();
+            job = makeJob();
+            resumed = false;
         }
-        counter++;
-
-        // Read next tag
-        uint16_t id;
-        if (isAtLeastDARTLOG2) {
-            uint8_t idPart = readUint8();
-            if (idPart == 255)
-                id = readUint16();
-            else if (idPart == 254)
-                id = lastID + 1;
-            else
-                id = idPart;
+    }
+
+    if (!resumed) {
+        _resume = DartlogResume();
+        _resume_data.clear();
+        if (incrementalReload()) {
+            _resume.filename = info->filename;
+            _resume.timeReset = (int) _time_reset;
+            job->resume = &_resume;
         }
-        else
-            id = readUint16();
+        ok = loadFile(*job, info, plot_data);
+    }
 
-        lastID = id;
+    // Keep the series to continue from, if the log could be loaded to its end
+    _resume_data.clear();
+    if (ok && job->resume && _resume.offset > 0) {
+        copySeries(plot_data, _resume_data);
+        _resume.tagNames = job->tagNames;
+        _resume.timeMin = job->timeMin;
+        _resume.timeMax = job->timeMax;
+        _resume.verboseSignalsIgnoredCount = job->verboseSignalsIgnoredCount;
+    }
+    else
+        _resume = DartlogResume();
 
-        if (id == 0) {
-            uint16_t tagIndex = readUint16();
+    if (!job->errors.isEmpty())
+        QMessageBox::warning(nullptr, "Error reading file", job->errors.join("\n"));
 
-            uint8_t tagType;
-            read((char *) &tagType, sizeof(tagType));
+    if (ok && job->version < 3) {
+        _last_filename = info->filename;
+        _last_tag_names = job->tagNames;
+        _last_time_min = job->timeMin;
+        _last_time_max = job->timeMax;
+    }
 
-            if (tagType < 1 || tagType > 10) {
-                QMessageBox::warning(nullptr, "Error reading file", "Wrong tag type read");
-                break;
-            }
+    // QMessageBox::information(nullptr, "File successfully read",  QString("Found %1 signals").arg(maxTagID));
 
-            tags[tagIndex] = tagType;
-            if (tagIndex > maxTagID)
-                maxTagID = tagIndex;
+    progress_dialog.close();
+    return ok;
+}
 
-            std::string name = readString();
+/**
+ * @brief Checks if logs are loaded to be continued on reload, see canResume()
+ *
+ * Decimation, changes only and overview series depend on the samples before, these logs are always loaded again.
+ */
+bool DataLoadDARTLog::incrementalReload() const {
+    return _incremental_reload && !_changes_only && !_overview && _decimation_width == 0 && _decimation_signals.empty();
+}
 
-            if (name.length() == 0) {
-                QMessageBox::warning(nullptr, "Error reading file", "Empty tag name read");
-                break;
-            }
+/**
+ * @brief Checks if the log loaded before can be continued where it ended instead of loaded again, i.e.
+ * it was only appended to since and is loaded with the same options
+ */
+bool DataLoadDARTLog::canResume(const QString &filename) const {
+    if (!incrementalReload())
+        return false;
+
+    if (_resume.filename != filename || _resume.timeReset != (int) _time_reset || _resume.offset <= 0 ||
+        _resume_data.numeric.empty())
+        return false;
+    return _resume.matchesFile();
+}
 
+/**
+ * @brief Loads all logs of a list file at once, see loadJobs()
+ *
+ * The list holds one log per line, relative to the list; lines starting with '#' are ignored. A line
+ * DARTLOG_LIST_SEGMENTS marks the logs as segments of a single log instead, see loadSegments().
+ */
+bool DataLoadDARTLog::loadFileList(FileLoadInfo *info, PlotDataMapRef &plot_data, QProgressDialog &progress_dialog) {
+    QFile listFile(info->filename);
+    if (!listFile.open(QFile::ReadOnly | QFile::Text)) {
+        QMessageBox::warning(nullptr, "Error reading file", "Could not open file");
+        return false;
+    }
 
-            std::string unit = "";
-            bool verbose = false;
-            if (isAtLeastDARTLOG2)
-            {
-                while (true)
-                {
-                    uint8_t attributeType;
-                    read((char*)&attributeType, sizeof(attributeType));
+    QDir listDir = QFileInfo(info->filename).absoluteDir();
+    QStringList filenames;
+    bool segments = false;
+    for (const QString &line : QString::fromUtf8(listFile.readAll()).split("\n")) {
+        QString filename = line.trimmed();
+        if (filename == DARTLOG_LIST_SEGMENTS)
+            segments = true;
+        else if (!filename.isEmpty() && !filename.startsWith("#"))
+            filenames.append(listDir.absoluteFilePath(filename));
+    }
 
-                    if (attributeType == 0)
-                        break;
+    if (filenames.isEmpty()) {
+        QMessageBox::warning(nullptr, "Error reading file", "The list does not name any log");
+        return false;
+    }
 
-                    uint8_t attributeLength;
-                    read((char*)&attributeLength, sizeof(attributeLength));
-
-                    switch (attributeType)
-                    {
-                        case 1: {   // unit
-                            unit = readString();
-                            std::replace(unit.begin(), unit.end(), '/', '_');
-                            break;
-                        }
-                        case 2: { // verbose signal
-                            verbose = readUint8() > 0;
-                            break;
-                        }
-                          
-                        default:
-                            skip(attributeLength);
-                            break;
-                    }
-                }
-            }
+    if (segments)
+        return loadSegments(filenames, plot_data, progress_dialog);
 
-            std::replace(name.begin(), name.end(), '_', '/');
+    std::vector<LoadJob> jobs(filenames.size());
+    for (int i = 0; i < filenames.size(); i++)
+        jobs[i].filename = filenames[i];
 
-            if (name == "time")
-                timeTagID = tagIndex;
+    return loadJobs(jobs, info, plot_data, progress_dialog);
+}
 
-            if (usePrefix) 
-                name = fileInfo.baseName().toStdString() + "/" + name;
+/**
+ * @brief Loads logs stored in a zip or tar archive straight from the archive, without extracting them
+ *
+ * If the archive holds several logs, one of them or all of them side by side can be chosen; the
+ * latter are loaded concurrently like the logs of a list file.
+ */
+bool DataLoadDARTLog::loadArchive(FileLoadInfo *info, PlotDataMapRef &plot_data, QProgressDialog &progress_dialog) {
+    DartlogArchive archive;
+    if (!archive.open(info->filename, &progress_dialog)) {
+        QMessageBox::warning(nullptr, "Error reading file", archive.errorString());
+        return false;
+    }
 
-            // Check if the name is the start of a different value
-            for (size_t i = 0; i < tagNames.size(); i++) {
-                if (tagNames[i]._Starts_with(name)) {
-                    name += "/Value";
-                    break;
-                }
-            }
+    const std::vector<DartlogArchiveMember> &members = archive.members();
+    if (members.empty()) {
+        QMessageBox::warning(nullptr, "Error reading file", "The archive does not contain any log");
+        return false;
+    }
 
-            // Add unit
-            if (unit.length() > 0)
-                name += "_" + unit;
+    // Index of the member, -1 for all of them
+    int chosen = 0;
+    if (members.size() > 1) {
+        QStringList items;
+        items << "All logs side by side";
+        for (const DartlogArchiveMember &member : members)
+            items << member.name;
+
+        bool ok;
+        QString item = QInputDialog::getItem(nullptr, "Load from archive", "Log:", items, 0, false, &ok);
+        if (!ok)
+            return false;
+        chosen = items.indexOf(item) - 1;
+    }
 
-            tagIndices.push_back(tagIndex);
-            tagNames.push_back(name);
+    if (chosen >= 0) {
+        LoadJob job;
+        job.filename = members[chosen].name;
+        job.archive = &archive;
+        job.member = chosen;
+        job.dialog = &progress_dialog;
+
+        bool ok = loadFile(job, info, plot_data);
+        if (!job.errors.isEmpty())
+            QMessageBox::warning(nullptr, "Error reading file", job.errors.join("\n"));
+        return ok;
+    }
 
-            if (verbose && !loadVerboseData) {
-                plots[tagIndex] = nullptr;
-                verboseSignalsIgnoredCount++;
-            }
-            else {
-                auto it = plot_data.addNumeric(name);
-                plots[tagIndex] = &it->second;
-            }
+    std::vector<LoadJob> jobs(members.size());
+    for (size_t i = 0; i < members.size(); i++) {
+        jobs[i].filename = members[i].name;
+        jobs[i].archive = &archive;
+        jobs[i].member = i;
+    }
+
+    return loadJobs(jobs, info, plot_data, progress_dialog);
+}
 
-            isVerbose[tagIndex] = verbose;
+/**
+ * @brief Loads several logs at once, each on its own thread and with its base name as prefix
+ */
+bool DataLoadDARTLog::loadJobs(std::vector<LoadJob> &jobs, FileLoadInfo *info, PlotDataMapRef &plot_data, QProgressDialog &progress_dialog) {
+    // Every file gets its own prefix, so their series never collide
+    std::set<std::string> prefixes;
+    std::atomic<bool> canceled(false);
+
+    for (LoadJob &job : jobs) {
+        std::string prefix = QFileInfo(job.filename).baseName().toStdString();
+        for (int n = 2; prefixes.count(prefix) > 0; n++)
+            prefix = QFileInfo(job.filename).baseName().toStdString() + "_" + std::to_string(n);
+        prefixes.insert(prefix);
+
+        job.prefix = prefix;
+        job.canceled = &canceled;
+    }
+
+    progress_dialog.setLabelText(QString("Loading %1 files... please wait").arg(jobs.size()));
+    progress_dialog.setRange(0, 1000);
+
+    // Each file is decompressed and decoded on a single core, see parallelFor()
+    std::vector<char> loaded(jobs.size(), false);
+    parallelFor(jobs.size(), [&](size_t i) {
+        loaded[i] = loadFile(jobs[i], info, plot_data);
+    }, [&](size_t) {
+        double done = 0;
+        for (const LoadJob &job : jobs)
+            done += job.progress();
+
+        progress_dialog.setValue((int) (1000 * done / jobs.size()));
+        QApplication::processEvents();
+        if (progress_dialog.wasCanceled())
+            canceled = true;
+        return !canceled;
+    });
+
+    QStringList errors;
+    for (const LoadJob &job : jobs) {
+        for (const QString &error : job.errors)
+            errors.append(QFileInfo(job.filename).fileName() + ": " + error);
+    }
+    if (!errors.isEmpty())
+        QMessageBox::warning(nullptr, "Error reading file", errors.join("\n"));
+
+    // Failed if no file could be read at all
+    return !canceled && std::find(loaded.begin(), loaded.end(), true) != loaded.end();
+}
 
-            lastValue[tagIndex] = DBL_MAX;
-            lastTime[tagIndex] = -1;
-        } else {
-            if (id > maxTagID) {
-                QMessageBox::warning(nullptr, "Error reading file", "Invalid ID read: over max tag id");
+/**
+ * @brief Loads the segments of one log, e.g. files rotated by the logger, into one set of continuous series
+ *
+ * The segments are ordered by their first time, read from the start of each file only. They are then
+ * decoded on all cores a window at a time, and their values added in order. Tags are matched by name and
+ * unit across the tag tables of the segments, as the IDs may differ from one segment to the next.
+ */
+bool DataLoadDARTLog::loadSegments(const QStringList &filenames, PlotDataMapRef &plot_data, QProgressDialog &progress_dialog) {
+    struct Segment {
+        QString filename;
+        double firstTime = DBL_MAX;
+        int version = 0;
+        DartlogInput::Compression compression = DartlogInput::None;
+
+        // Every tag definition with its values as column of the same index; when splitting a definition
+        // continues in a new one after every time reset
+        std::vector<DartlogTag> tags;
+        std::vector<uint32_t> parts;
+        DartlogStaging values;
+        uint32_t timeResets = 0;
+        double timeOffset = 0;
+        QStringList errors;
+    };
+
+    std::vector<Segment> segments(filenames.size());
+    for (int i = 0; i < filenames.size(); i++)
+        segments[i].filename = filenames[i];
+
+    parallelFor(segments.size(), [&](size_t i) {
+        DartlogInput input;
+        if (!input.openHead(segments[i].filename, DARTLOG_SEGMENT_HEAD_SIZE))
+            return;
+
+        DartlogParser parser(input);
+        if (!parser.readHeader())
+            return;
+
+        uint16_t timeID = 0;
+        while (true) {
+            DartlogParser::Record record = parser.next();
+            if (record == DartlogParser::End || record == DartlogParser::Error)
                 break;
-            }
-            if (tags.find(id) == tags.end()) {
-                QMessageBox::warning(nullptr, "Error reading file", "Invalid ID read: unknown tag id");
+
+            if (record == DartlogParser::TagDefinition && parser.tag().name == "time")
+                timeID = parser.tag().index;
+            else if (record == DartlogParser::Value && parser.valueID() == timeID) {
+                segments[i].firstTime = parser.time();
                 break;
             }
+        }
+    });
+
+    // Segments without any time go last
+    std::stable_sort(segments.begin(), segments.end(),
+                     [](const Segment &a, const Segment &b) { return a.firstTime < b.firstTime; });
+
+    bool split = _time_reset == DartlogTimeReset::Split;
+    auto decodeSegment = [&](Segment &segment) {
+        DartlogInput input;
+        if (!input.open(segment.filename, nullptr)) {
+            segment.errors.append(input.errorString());
+            return;
+        }
+        if (!input.warningString().isEmpty())
+            segment.errors.append(input.warningString());
 
-            // Read value
-            uint8_t type = tags[id];
-
-            double value = 0;
-            switch (type) {
-                case 1: {
-                    uint8_t v;
-                    read((char *) &v, sizeof(v));
-                    value = (double) v;
-                    break;
-                }
-                case 2: {
-                    uint16_t v;
-                    read((char *) &v, sizeof(v));
-                    value = (double) v;
-                    break;
-                }
-                case 3: {
-                    uint32_t v;
-                    read((char *) &v, sizeof(v));
-                    value = (double) v;
-                    break;
-                }
-                case 4: {
-                    int8_t v;
-                    read((char *) &v, sizeof(v));
-                    value = (double) v;
-                    break;
-                }
-                case 5: {
-                    int16_t v;
-                    read((char *) &v, sizeof(v));
-                    value = (double) v;
-                    break;
-                }
-                case 6: {
-                    int32_t v;
-                    read((char *) &v, sizeof(v));
-                    value = (double) v;
+        DartlogParser parser(input);
+        if (!parser.readHeader() || parser.version() >= 3) {
+            segment.errors.append("Not a DARTLOG or DARTLOG2 file: header missing.");
+            return;
+        }
+        segment.version = parser.version();
+        segment.compression = input.compression();
+        parser.setOffsetTimeResets(_time_reset == DartlogTimeReset::Offset);
+
+        // By value ID, when splitting also by the number of time resets (upper 16 bits)
+        std::unordered_map<uint32_t, size_t> definitions;
+        uint32_t part = 0;
+        dartlogDispatchVersion(parser.version(), [&](auto version) {
+            constexpr int Version = decltype(version)::value;
+
+            while (true) {
+                DartlogParser::Record record = parser.next<Version>();
+                if (record == DartlogParser::End)
                     break;
-                }
-                case 7: {
-                    float v;
-                    read((char *) &v, sizeof(v));
-                    value = (double) v;
+
+                if (record == DartlogParser::Error) {
+                    segment.errors.append(parser.errorString());
                     break;
                 }
-                case 8: {
-                    double v;
-                    read((char *) &v, sizeof(v));
-                    value = (double) v;
-                    break;
+
+                // Parts past the 16 bits of the key continue the last one
+                uint32_t resets = std::min<uint32_t>(parser.timeResets(), 0xFFFF);
+                if (split && resets != part) {
+                    // Every tag continues in a new definition
+                    part = resets;
+                    std::unordered_map<uint32_t, size_t> partDefinitions;
+                    for (const auto &definition : definitions) {
+                        partDefinitions[(definition.first & 0xFFFF) | (part << 16)] = segment.tags.size();
+                        segment.tags.push_back(segment.tags[definition.second]);
+                        segment.parts.push_back(part);
+                    }
+                    definitions.swap(partDefinitions);
                 }
-                case 9: {
-                    uint64_t v;
-                    read((char *) &v, sizeof(v));
-                    value = (double) v;
-                    break;
+
+                if (record == DartlogParser::TagDefinition) {
+                    definitions[parser.tag().index | (part << 16)] = segment.tags.size();
+                    segment.tags.push_back(parser.tag());
+                    segment.parts.push_back(part);
                 }
-                case 10: {
-                    int64_t v;
-                    read((char *) &v, sizeof(v));
-                    value = (double) v;
-                    break;
+                else {
+                    size_t definition = definitions[parser.valueID() | (part << 16)];
+                    if (!segment.tags[definition].verbose)
+                        segment.values.add((uint32_t) definition, parser.valueType(), parser.rawValue(), parser.time());
                 }
             }
+        });
+        segment.values.convert();
+        segment.timeResets = parser.timeResets();
+        segment.timeOffset = parser.timeOffset();
 
-            if (id == timeTagID)
-                time = value;
+        if (input.hasStreamError())
+            segment.errors.append("Could not fully decompress file: data may be incomplete");
+    };
 
-            // Skip verbose values
-            PJ::PlotData* data = plots[id];
-            if (data == nullptr)
-                continue;
+    std::map<std::string, std::string> seriesNames;
+    std::map<std::string, DartlogSeries> plots;
+    std::set<std::string> tagNames;
+    std::set<std::string> verboseNames;
+    QStringList errors;
+
+    // Time resets and offset of all segments added so far
+    uint32_t resetsBefore = 0;
+    double offsetBefore = 0;
+
+    progress_dialog.setLabelText(QString("Loading %1 segments... please wait").arg(filenames.size()));
+    progress_dialog.setRange(0, (int) segments.size());
 
-#if REDUCE_PLOT
-            double lastVal = lastValue[id];
-            double lastT = lastTime[id];
+    // Only a window of decoded segments is kept in memory
+    size_t windowSize = qMax(1u, std::thread::hardware_concurrency());
+    bool completed = true;
 
-            bool valueChanged = std::abs(lastVal - value) >= 0.00001;
-            bool timeChanged = std::abs(time - lastT) >= 0.1;
+    for (size_t first = 0; first < segments.size() && completed; first += windowSize) {
+        size_t count = qMin(windowSize, segments.size() - first);
 
-            if (valueChanged || timeChanged || isXY[id]) {
-#if ADD_EDGES_TO_PLOT
-                // Add point just before last value to ensure edges are in plot
-                if (lastT >= 0 && valueChanged && timeChanged) {
-                    PlotData::Point point(time - 0.001, lastVal);
-                    plots[id]->pushBack(point);
+        completed = parallelFor(count, [&](size_t i) { decodeSegment(segments[first + i]); }, [&](size_t done) {
+            progress_dialog.setValue((int) (first + done));
+            QApplication::processEvents();
+            return !progress_dialog.wasCanceled();
+        });
+
+        for (size_t i = first; i < first + count && completed; i++) {
+            Segment &segment = segments[i];
+            for (const QString &error : segment.errors)
+                errors.append(QFileInfo(segment.filename).fileName() + ": " + error);
+
+            for (size_t d = 0; d < segment.tags.size(); d++) {
+                const DartlogTag &tag = segment.tags[d];
+
+                // The same tag continues the same series in every segment. Verbose tags are named as well,
+                // as by the other loads, so the other series are named the same.
+                std::string key = tag.name + '\0' + tag.unit;
+                auto name = seriesNames.find(key);
+                if (name == seriesNames.end())
+                    name = seriesNames.emplace(key, makeSeriesName(tag, "", tagNames)).first;
+
+                if (tag.verbose) {
+                    verboseNames.insert(tag.name);
+                    continue;
                 }
-#endif
 
-                PlotData::Point point(time, value);
-                plots[id]->pushBack(point);
+                uint32_t part = resetsBefore + segment.parts[d];
+                auto series = plots.find(name->second);
+                if (series == plots.end())
+                    series = plots.emplace(name->second, makeSeries(plot_data, name->second, part)).first;
 
-                lastTime[id] = time;
-                lastValue[id] = value;
+                const DartlogStaging::Column *values = segment.values.column((uint32_t) d);
+                if (values)
+                    series->second.push(*values, segment.values.times(), offsetBefore, part);
             }
-#else
-            PlotData::Point point(time, value);
-            data->pushBack(point);
-#endif
+            resetsBefore += segment.timeResets;
+            offsetBefore += segment.timeOffset;
+
+            segment.tags.clear();
+            segment.parts.clear();
+            segment.values.clear();
         }
     }
 
+    for (auto &series : plots)
+        finishSeries(series.second, plot_data);
 
-    // Add for all tags last value at the current time
-    for (size_t i = 0; i < tagIndices.size(); i++) {
-        uint16_t tagIndex = tagIndices[i];
-        if (plots[tagIndex] != nullptr && lastValue[tagIndex] != DBL_MAX) {
-            PlotData::Point point(time, lastValue[tagIndex]);
-            plots[tagIndex]->pushBack(point);
-        }
+    if (!errors.isEmpty())
+        QMessageBox::warning(nullptr, "Error reading file", errors.join("\n"));
+
+    // Add logger informations of the first segment
+    PlotData::Point version(0, 13);
+    plot_data.addNumeric("dartlog_version_data")->second.pushBack(PlotData::Point(0, segments.front().version));
+    plot_data.addNumeric("dartlog_version_plugin")->second.pushBack(version);
+    plot_data.addNumeric("dartlog_is_gzip")->second.pushBack(PlotData::Point(0, segments.front().compression == DartlogInput::GZip ? 1 : 0));
+    plot_data.addNumeric("dartlog_is_lz4")->second.pushBack(PlotData::Point(0, segments.front().compression == DartlogInput::LZ4 ? 1 : 0));
+    plot_data.addNumeric("VERBOSE_DATA_NOT_LOADED")->second.pushBack(PlotData::Point(0, verboseNames.size()));
+    plot_data.addNumeric("verbose_signal_count")->second.pushBack(PlotData::Point(0, verboseNames.size()));
+
+    return completed;
+}
+
+/**
+ * @brief Loads one log into its series
+ *
+ * Runs on a worker thread when loading a list of files: the job then has no dialog, reports its progress
+ * through progress() and only creates series while holding _series_mutex.
+ * @return @c false if the file could not be read at all
+ */
+bool DataLoadDARTLog::loadFile(LoadJob &job, FileLoadInfo *info, PlotDataMapRef &plot_data) {
+    DartlogInput input;
+    bool resuming = job.resume && job.resume->offset > 0;
+    bool opened;
+    if (resuming)
+        opened = input.openTail(job.filename, job.resume->offset, job.resume->gzip ? &job.resume->inflatePoint : nullptr, job.dialog);
+    else
+        opened = job.archive ? input.open(*job.archive, job.member, job.dialog) : input.open(job.filename, job.dialog, job.resume != nullptr);
+    if (!opened) {
+        job.errors.append(input.errorString());
+        return false;
+    }
+
+    if (!input.warningString().isEmpty())
+        job.errors.append(input.warningString());
+
+    if (job.dialog)
+        job.dialog->setLabelText("Loading data... please wait");
+    job.setRange(input.getSize());
+    job.setValue(0);
+
+    // Read header, or continue with the state where the log was loaded before
+    DartlogParser parser(input);
+    if (resuming)
+        parser.setState(job.resume->state);
+    else if (!parser.readHeader()) {
+        job.errors.append("Not a DARTLOG file: header missing.");
+        return false;
+    }
+
+    job.version = parser.version();
+    parser.setOffsetTimeResets(_time_reset == DartlogTimeReset::Offset);
+
+    if (parser.version() >= 3)
+        loadDartlog3(input, info, plot_data, job);
+    else {
+        if (input.blocks().empty())
+            loadRecords(input, parser, plot_data, job);
+        else
+            loadBlocks(input, parser, plot_data, job);
+
+        // Redefined tags are listed once
+        std::sort(job.tagNames.begin(), job.tagNames.end());
+        job.tagNames.erase(std::unique(job.tagNames.begin(), job.tagNames.end()), job.tagNames.end());
+    }
+
+    if (input.hasStreamError()) {
+        job.errors.append("Could not fully decompress file: data may be incomplete");
     }
 
     // Add logger informations
-    PlotData::Point version(0, 12);
-    plot_data.addNumeric("dartlog_version_data")->second.pushBack(dartLogVersion);
-    plot_data.addNumeric("dartlog_version_plugin")->second.pushBack(version);
+    std::lock_guard<std::mutex> lock(_series_mutex);
+    std::string infoPrefix = job.prefix.empty() ? "" : job.prefix + "/";
+
+    // Single points, replaced when continuing a log loaded before
+    auto setInfo = [&](const std::string &name, double value) {
+        PlotData &series = plot_data.addNumeric(infoPrefix + name)->second;
+        series.clear();
+        series.pushBack(PlotData::Point(0, value));
+    };
+
+    setInfo("dartlog_version_data", parser.version());
+    setInfo("dartlog_version_plugin", 13);
+    setInfo("dartlog_is_gzip", input.compression() == DartlogInput::GZip ? 1 : 0);
+    setInfo("dartlog_is_lz4", input.compression() == DartlogInput::LZ4 ? 1 : 0);
+
+    if (!job.loadVerboseData) {
+        setInfo("VERBOSE_DATA_NOT_LOADED", job.verboseSignalsIgnoredCount);
+        setInfo("verbose_signal_count", job.verboseSignalsIgnoredCount);
+    }
 
-    PlotData::Point gzipPoint(0, isGZip ? 1 : 0);
-    plot_data.addNumeric("dartlog_is_gzip")->second.pushBack(gzipPoint);
+    return true;
+}
 
-    if (!loadVerboseData) {
-        PlotData::Point verbosePoint(0, verboseSignalsIgnoredCount);
-        plot_data.addNumeric("VERBOSE_DATA_NOT_LOADED")->second.pushBack(verbosePoint);
-        PlotData::Point verboseCountPoint(0, verboseSignalsIgnoredCount);
-        plot_data.addNumeric("verbose_signal_count")->second.pushBack(verboseCountPoint);
+/**
+ * @brief Reports the progress to the dialog, or stores it for the thread showing the dialog
+ * @return @c false if the load was canceled
+ */
+bool DataLoadDARTLog::LoadJob::setValue(qint64 value) {
+    progressValue = value;
+    if (dialog) {
+        dialog->setValue((int) (1000 * progress()));
+        QApplication::processEvents();
+        return !dialog->wasCanceled();
+    }
+    return !(canceled && *canceled);
+}
+
+void DataLoadDARTLog::LoadJob::setRange(qint64 maximum) {
+    // The dialog shows per mille, as logs may exceed the int range of the dialog
+    if (dialog)
+        dialog->setRange(0, 1000);
+    progressMaximum = maximum;
+}
+
+// Share of the job done, from 0 to 1
+double DataLoadDARTLog::LoadJob::progress() const {
+    qint64 maximum = progressMaximum;
+    return maximum > 0 ? qMin(1.0, (double) progressValue / maximum) : 0;
+}
 
-        
+/**
+ * @brief Stores where a log was loaded to, see DartlogResume
+ */
+static QDomElement saveResume(QDomDocument &doc, const DartlogResume &resume) {
+    QDomElement element = doc.createElement("resume");
+    element.setAttribute("file", resume.filename);
+    element.setAttribute("offset", QString::number(resume.offset));
+    element.setAttribute("check_offset", QString::number(resume.checkOffset));
+    element.setAttribute("checksum", QString::number(resume.checksum));
+    element.setAttribute("time_reset", QString::number(resume.timeReset));
+    element.setAttribute("time_min", QString::number(resume.timeMin, 'g', 17));
+    element.setAttribute("time_max", QString::number(resume.timeMax, 'g', 17));
+    element.setAttribute("verbose_ignored", QString::number(resume.verboseSignalsIgnoredCount));
+
+    // Parser state, the tags as id:type
+    const DartlogParserState &state = resume.state;
+    QStringList tags;
+    for (const auto &tag : state.tags)
+        tags.append(QString::number(tag.first) + ":" + QString::number(tag.second));
+    element.setAttribute("version", QString::number(state.version));
+    element.setAttribute("tags", tags.join(","));
+    element.setAttribute("max_tag_id", QString::number(state.maxTagID));
+    element.setAttribute("time_tag_id", QString::number(state.timeTagID));
+    element.setAttribute("last_id", QString::number(state.lastID));
+    element.setAttribute("time", QString::number(state.time, 'g', 9));
+    element.setAttribute("has_time", state.hasTime ? "true" : "false");
+    element.setAttribute("time_resets", QString::number(state.timeResets));
+    element.setAttribute("time_offset", QString::number(state.timeOffset, 'g', 17));
+
+    // Inflate state of gzip logs
+    if (resume.gzip) {
+        element.setAttribute("gzip_in", QString::number(resume.inflatePoint.in));
+        element.setAttribute("gzip_bits", QString::number(resume.inflatePoint.bits));
+        element.setAttribute("gzip_out", QString::number(resume.inflatePoint.out));
+        element.setAttribute("gzip_member_start", resume.inflatePoint.memberStart ? "true" : "false");
+        element.setAttribute("gzip_window", QString::fromLatin1(resume.inflatePoint.window.toBase64()));
     }
 
-    // QMessageBox::information(nullptr, "File successfully read",  QString("Found %1 signals").arg(maxTagID));
+    for (const auto &series : resume.series) {
+        QDomElement seriesElement = doc.createElement("series");
+        seriesElement.setAttribute("id", QString::number(series.first));
+        seriesElement.setAttribute("name", QString::fromStdString(series.second.name));
+        seriesElement.setAttribute("part", QString::number(series.second.part));
+        element.appendChild(seriesElement);
+    }
+    for (const std::string &name : resume.seriesNames) {
+        QDomElement nameElement = doc.createElement("series_name");
+        nameElement.setAttribute("name", QString::fromStdString(name));
+        element.appendChild(nameElement);
+    }
+    for (const std::string &name : resume.tagNames) {
+        QDomElement nameElement = doc.createElement("tag_name");
+        nameElement.setAttribute("name", QString::fromStdString(name));
+        element.appendChild(nameElement);
+    }
+    return element;
+}
 
-    close();
-    progress_dialog.close();
+/**
+ * @return @c false if the stored state is incomplete
+ */
+static bool loadResume(const QDomElement &element, DartlogResume &resume) {
+    bool ok = true;
+    auto number = [&](const char *name) {
+        bool valid;
+        qint64 value = element.attribute(name).toLongLong(&valid);
+        ok = ok && valid;
+        return value;
+    };
+    auto real = [&](const char *name) {
+        bool valid;
+        double value = element.attribute(name).toDouble(&valid);
+        ok = ok && valid;
+        return value;
+    };
+
+    resume.filename = element.attribute("file");
+    resume.offset = number("offset");
+    resume.checkOffset = number("check_offset");
+    resume.checksum = (quint32) number("checksum");
+    resume.timeReset = (int) number("time_reset");
+    resume.timeMin = real("time_min");
+    resume.timeMax = real("time_max");
+    resume.verboseSignalsIgnoredCount = (uint32_t) number("verbose_ignored");
+
+    DartlogParserState &state = resume.state;
+    state.version = (int) number("version");
+    for (const QString &tag : element.attribute("tags").split(",")) {
+        int separator = tag.indexOf(":");
+        if (separator <= 0)
+            continue;
+
+        bool validID, validType;
+        int id = tag.left(separator).toInt(&validID);
+        int type = tag.mid(separator + 1).toInt(&validType);
+        if (!validID || !validType)
+            return false;
+        state.tags[(uint16_t) id] = (uint8_t) type;
+    }
+    state.maxTagID = (uint16_t) number("max_tag_id");
+    state.timeTagID = (uint16_t) number("time_tag_id");
+    state.lastID = (uint16_t) number("last_id");
+    state.time = (float) real("time");
+    state.hasTime = element.attribute("has_time") == "true";
+    state.timeResets = (uint32_t) number("time_resets");
+    state.timeOffset = real("time_offset");
+
+    resume.gzip = element.hasAttribute("gzip_in");
+    if (resume.gzip) {
+        resume.inflatePoint.in = number("gzip_in");
+        resume.inflatePoint.bits = (int) number("gzip_bits");
+        resume.inflatePoint.out = number("gzip_out");
+        resume.inflatePoint.memberStart = element.attribute("gzip_member_start") == "true";
+        resume.inflatePoint.window = QByteArray::fromBase64(element.attribute("gzip_window").toLatin1());
+    }
+
+    for (QDomElement child = element.firstChildElement("series"); !child.isNull(); child = child.nextSiblingElement("series")) {
+        DartlogResume::Series &series = resume.series[(uint16_t) child.attribute("id").toInt()];
+        series.name = child.attribute("name").toStdString();
+        series.part = (uint32_t) child.attribute("part").toLongLong();
+    }
+    for (QDomElement child = element.firstChildElement("series_name"); !child.isNull();
+         child = child.nextSiblingElement("series_name"))
+        resume.seriesNames.push_back(child.attribute("name").toStdString());
+    for (QDomElement child = element.firstChildElement("tag_name"); !child.isNull(); child = child.nextSiblingElement("tag_name"))
+        resume.tagNames.push_back(child.attribute("name").toStdString());
+    return ok;
+}
+
+bool DataLoadDARTLog::xmlSaveState(QDomDocument &doc, QDomElement &parent_element) const {
+    parent_element.setAttribute("time_window_start", QString::number(_time_window_start, 'g', 17));
+    parent_element.setAttribute("time_window_end", QString::number(_time_window_end, 'g', 17));
+    parent_element.setAttribute("decimation_width", QString::number(_decimation_width, 'g', 17));
+    parent_element.setAttribute("changes_only", _changes_only ? "true" : "false");
+    parent_element.setAttribute("overview", _overview ? "true" : "false");
+    parent_element.setAttribute("incremental_reload", _incremental_reload ? "true" : "false");
+    parent_element.setAttribute("time_reset", _time_reset == DartlogTimeReset::Split    ? "split"
+                                              : _time_reset == DartlogTimeReset::Offset ? "offset"
+                                                                                        : "sort");
+
+    for (const auto &signal : _decimation_signals) {
+        QDomElement element = doc.createElement("decimation");
+        element.setAttribute("series", QString::fromStdString(signal.first));
+        element.setAttribute("width", QString::number(signal.second, 'g', 17));
+        parent_element.appendChild(element);
+    }
+
+    if (_resume.offset > 0)
+        parent_element.appendChild(saveResume(doc, _resume));
+    return true;
+}
+
+bool DataLoadDARTLog::xmlLoadState(const QDomElement &parent_element) {
+    bool ok;
+    double start = parent_element.attribute("time_window_start").toDouble(&ok);
+    _time_window_start = ok ? start : -DBL_MAX;
+    double end = parent_element.attribute("time_window_end").toDouble(&ok);
+    _time_window_end = ok ? end : DBL_MAX;
+    double width = parent_element.attribute("decimation_width").toDouble(&ok);
+    _decimation_width = ok ? width : 0;
+    _changes_only = parent_element.attribute("changes_only") == "true";
+    _changes_only_action->setChecked(_changes_only);
+    _overview = parent_element.attribute("overview") == "true";
+    _overview_action->setChecked(_overview);
+    _incremental_reload = parent_element.attribute("incremental_reload") == "true";
+    _incremental_reload_action->setChecked(_incremental_reload);
+
+    QString timeReset = parent_element.attribute("time_reset");
+    _time_reset = timeReset == "split"    ? DartlogTimeReset::Split
+                  : timeReset == "offset" ? DartlogTimeReset::Offset
+                                          : DartlogTimeReset::Sort;
+
+    _decimation_signals.clear();
+    for (QDomElement element = parent_element.firstChildElement("decimation"); !element.isNull();
+         element = element.nextSiblingElement("decimation")) {
+        width = element.attribute("width").toDouble(&ok);
+        if (ok)
+            _decimation_signals[element.attribute("series").toStdString()] = width;
+    }
+
+    // The series kept in memory only belong to the state they were loaded with
+    QDomElement resumeElement = parent_element.firstChildElement("resume");
+    if (!resumeElement.isNull()) {
+        DartlogResume resume;
+        if (!loadResume(resumeElement, resume))
+            resume = DartlogResume();
+        if (resume.filename != _resume.filename || resume.offset != _resume.offset || resume.checksum != _resume.checksum) {
+            _resume = resume;
+            _resume_data.clear();
+        }
+    }
     return true;
 }
 
-void DataLoadDARTLog::close() {
-    if (inputFile != nullptr)
-        inputFile->close();
+const std::vector<QAction *> &DataLoadDARTLog::availableActions() {
+    return _actions;
 }
 
-qint64 DataLoadDARTLog::getPos() {
-    if (inputFile != nullptr)
-        return inputFile->pos();
-    return pos;
+void DataLoadDARTLog::exportSubset() {
+    if (_last_filename.isEmpty()) {
+        QMessageBox::information(nullptr, "Export subset", "Load a DARTLOG or DARTLOG2 file first.");
+        return;
+    }
+
+    DartlogExportDialog dialog(_last_tag_names, _last_time_min, _last_time_max);
+    if (dialog.exec() != QDialog::Accepted)
+        return;
+
+    QString outputFilename = QFileDialog::getSaveFileName(nullptr, "Export subset", QFileInfo(_last_filename).absolutePath(),
+                                                          "Compressed DARTLOG (*.gz);;DARTLOG (*.dat)");
+    if (outputFilename.isEmpty())
+        return;
+
+    DartlogExportOptions options;
+    options.tags = dialog.selectedTags();
+    options.timeStart = dialog.timeStart();
+    options.timeEnd = dialog.timeEnd();
+    options.compress = outputFilename.endsWith(".gz", Qt::CaseInsensitive);
+
+    QProgressDialog progress_dialog;
+    progress_dialog.setWindowTitle("DARTLOG Plugin");
+    progress_dialog.setLabelText("Exporting... please wait");
+    progress_dialog.setWindowModality(Qt::ApplicationModal);
+    progress_dialog.show();
+
+    auto progress = [&](qint64 pos, qint64 size) {
+        progress_dialog.setRange(0, size);
+        progress_dialog.setValue(pos);
+        QApplication::processEvents();
+        return !progress_dialog.wasCanceled();
+    };
+
+    QString error;
+    bool ok = exportDartlogSubset(_last_filename, outputFilename, options, error, progress);
+    progress_dialog.close();
+
+    if (!ok && !progress_dialog.wasCanceled())
+        QMessageBox::warning(nullptr, "Error exporting file", error);
 }
 
-qint64 DataLoadDARTLog::getSize() {
-    if (inputFile != nullptr)
-        return inputFile->size();
-    return inputData.size();
+void DataLoadDARTLog::createFileList() {
+    QStringList filenames = QFileDialog::getOpenFileNames(nullptr, "Create file list", QString(),
+                                                          "DARTLOG (*.dat *.gz *.lz4)");
+    if (filenames.isEmpty())
+        return;
+
+    bool segments = QMessageBox::question(nullptr, "Create file list",
+                                          "Are the files segments of one log, to be joined into continuous series?\n"
+                                          "Otherwise they are loaded side by side.",
+                                          QMessageBox::Yes | QMessageBox::No) == QMessageBox::StandardButton::Yes;
+
+    QString listFilename = QFileDialog::getSaveFileName(nullptr, "Create file list", QFileInfo(filenames.first()).absolutePath(),
+                                                        "DARTLOG list (*." DARTLOG_LIST_EXTENSION ")");
+    if (listFilename.isEmpty())
+        return;
+
+    // Logs are listed relative to the list, so the list moves with them
+    QDir listDir = QFileInfo(listFilename).absoluteDir();
+    QString list = segments ? DARTLOG_LIST_SEGMENTS "\n" : "";
+    for (const QString &filename : filenames)
+        list += listDir.relativeFilePath(filename) + "\n";
+
+    QFile listFile(listFilename);
+    if (!listFile.open(QFile::WriteOnly | QFile::Text) || listFile.write(list.toUtf8()) < 0) {
+        QMessageBox::warning(nullptr, "Create file list", "Could not write file: " + listFile.errorString());
+        return;
+    }
+
+    QMessageBox::information(nullptr, "Create file list",
+                             "Load the list like a log to load all files side by side, each with its name as prefix.");
 }
 
-bool DataLoadDARTLog::atEnd() {
-    if (inputFile != nullptr)
-        return inputFile->atEnd();
-    return pos >= inputData.size();
+void DataLoadDARTLog::configureTimeReset() {
+    QStringList items;
+    items << "Sort each series once at the end"
+          << "Split into series <series>_part<n> at every reset"
+          << "Offset later times to continue monotonically";
+
+    bool ok;
+    QString item = QInputDialog::getItem(nullptr, "Time resets",
+                                         "When the time of a log goes backwards, e.g. after the logger restarted its clock:",
+                                         items, (int) _time_reset, false, &ok);
+    if (!ok)
+        return;
+
+    _time_reset = (DartlogTimeReset) items.indexOf(item);
 }
 
-qint64 DataLoadDARTLog::read(char* data, qint64 maxLen) {
-    if (inputFile != nullptr)
-        return inputFile->read(data, maxLen);
+void DataLoadDARTLog::configureDecimation() {
+    bool ok;
+    double width = QInputDialog::getDouble(nullptr, "Load decimation",
+                                           "Keep the first, minimum, maximum and last sample of every time bucket.\n"
+                                           "Bucket width in seconds for all signals (0 loads every sample):",
+                                           _decimation_width, 0, 3600, 4, &ok);
+    if (!ok)
+        return;
+
+    QStringList entries;
+    for (const auto &signal : _decimation_signals)
+        entries.append(QString::fromStdString(signal.first) + "=" + QString::number(signal.second));
+
+    QString text = QInputDialog::getText(nullptr, "Load decimation",
+                                         "Bucket widths of single series, as series=seconds separated by commas:",
+                                         QLineEdit::Normal, entries.join(","), &ok);
+    if (!ok)
+        return;
+
+    std::map<std::string, double> signalWidths;
+    for (const QString &entry : text.split(",")) {
+        int separator = entry.lastIndexOf("=");
+        if (separator <= 0)
+            continue;
+
+        bool valid;
+        double signalWidth = entry.mid(separator + 1).trimmed().toDouble(&valid);
+        if (valid)
+            signalWidths[entry.left(separator).trimmed().toStdString()] = signalWidth;
+    }
+
+    _decimation_width = width;
+    _decimation_signals = signalWidths;
+}
 
-    for (size_t i = 0; i < maxLen; i++) {
-        if (atEnd())
-            break;
-        data[i] = inputData.at(pos++);
+/**
+ * @brief Creates the series of a tag with the load options applied
+ * @param part Number of time resets before, the part after a reset is a series of its own when splitting
+ */
+DartlogSeries DataLoadDARTLog::makeSeries(PlotDataMapRef &plot_data, const std::string &name, uint32_t part) {
+    std::string partName = part == 0 ? name : name + "_part" + std::to_string(part + 1);
+
+    std::lock_guard<std::mutex> lock(_series_mutex);
+    DartlogSeries series(&plot_data.addNumeric(partName)->second, decimationWidth(name), _changes_only);
+
+    if (_overview) {
+        // Companion series at 1/16, 1/256 and 1/4096 of the samples
+        std::vector<PlotData *> overviews;
+        int factor = 1;
+        for (int level = 0; level < DARTLOG_OVERVIEW_LEVELS; level++) {
+            factor *= DARTLOG_OVERVIEW_FACTOR;
+            std::string overviewName = "dartlog_overview_" + std::to_string(factor) + "/" + partName;
+            overviews.push_back(&plot_data.addNumeric(overviewName)->second);
+        }
+        series.setOverviews(overviews);
     }
-    return maxLen;
+
+    series.setSortSamples(_time_reset == DartlogTimeReset::Sort);
+    if (_time_reset == DartlogTimeReset::Split)
+        series.setParts(part, [this, &plot_data, name](uint32_t next) { return makeSeries(plot_data, name, next); },
+                        [this, &plot_data](DartlogSeries &finished) { finishSeries(finished, plot_data); });
+    return series;
 }
 
-void DataLoadDARTLog::skip(qint64 bytes) {
-    if (inputFile != nullptr)
-        inputFile->skip(bytes);
-    else
-        pos += bytes;
+/**
+ * @brief Adds the last points of a series and, when loading only changes, reports the share of samples kept
+ */
+void DataLoadDARTLog::finishSeries(DartlogSeries &series, PlotDataMapRef &plot_data) {
+    series.finish();
+    if (!_changes_only || series.isSkipped() || series.samples() == 0)
+        return;
+
+    std::lock_guard<std::mutex> lock(_series_mutex);
+    PlotData &ratio = plot_data.addNumeric("dartlog_reduction/" + series.name())->second;
+    ratio.clear();
+    ratio.pushBack(PlotData::Point(0, (double) series.points() / series.samples()));
+}
+
+double DataLoadDARTLog::decimationWidth(const std::string &seriesName) const {
+    auto it = _decimation_signals.find(seriesName);
+    return it != _decimation_signals.end() ? it->second : _decimation_width;
 }
 
-uint8_t DataLoadDARTLog::readUint8() {
-    uint8_t b;
-    read((char*)&b, sizeof(b));
-    return b;
+std::string DataLoadDARTLog::makeSeriesName(const DartlogTag &tag, const std::string &prefix, std::set<std::string> &tagNames) {
+    return dartlogSeriesName(tag, prefix, tagNames);
 }
 
-uint16_t DataLoadDARTLog::readUint16() {
-    uint8_t b[2];
-    read((char *) b, sizeof(b));
+void DataLoadDARTLog::loadRecords(DartlogInput &input, DartlogParser &parser, PlotDataMapRef &plot_data, LoadJob &job) {
+    std::map<uint16_t, DartlogSeries> plots;
+    std::set<std::string> tagNames;
+
+    // Values are staged raw and added a column at a time; skipped IDs are not staged at all
+    DartlogStaging staging;
+    uint32_t stagingResets = parser.timeResets();
+    std::vector<bool> skipped(UINT16_MAX + 1, false);
+
+    // Continue the series of the tags defined before
+    DartlogResume *resume = job.resume;
+    if (resume && resume->offset > 0) {
+        tagNames.insert(resume->seriesNames.begin(), resume->seriesNames.end());
+        for (const auto &it : resume->series) {
+            DartlogSeries &series = plots[it.first];
+            if (!it.second.name.empty()) {
+                series = makeSeries(plot_data, it.second.name, it.second.part);
+                series.resume();
+            }
+            skipped[it.first] = series.isSkipped();
+        }
+    }
+    bool complete = false;
+
+    auto addStaged = [&]() {
+        staging.convert();
+        for (uint32_t id : staging.keys())
+            plots[(uint16_t) id].push(*staging.column(id), staging.times(), 0, stagingResets);
+        staging.clear();
+    };
+
+    // The loop is compiled once per version, without checking the version on every record
+    dartlogDispatchVersion(parser.version(), [&](auto version) {
+        constexpr int Version = decltype(version)::value;
+
+        uint64_t counter = 0;
+
+        while (true) {
+            // Update file progress dialog
+            if (counter % (1024 * 32) == 0 && !job.setValue(input.getPos()))
+                break;
+            counter++;
+
+            DartlogParser::Record record = parser.next<Version>();
+            if (record == DartlogParser::End) {
+                complete = true;
+                break;
+            }
+
+            if (record == DartlogParser::Error) {
+                job.errors.append(parser.errorString());
+                break;
+            }
+
+            if (record == DartlogParser::TagDefinition) {
+                const DartlogTag &tag = parser.tag();
+                std::string name = makeSeriesName(tag, job.prefix, tagNames);
+
+                job.tagNames.push_back(tag.name);
+
+                // A redefined tag continues in a new series
+                addStaged();
+                DartlogSeries &series = plots[tag.index];
+                finishSeries(series, plot_data);
+
+                if (tag.verbose && !job.loadVerboseData) {
+                    series = DartlogSeries();
+                    job.verboseSignalsIgnoredCount++;
+                }
+                else
+                    series = makeSeries(plot_data, name, parser.timeResets());
+                skipped[tag.index] = series.isSkipped();
+
+                if (resume)
+                    resume->series[tag.index] = {series.isSkipped() ? "" : name, parser.timeResets()};
+            } else {
+                double time = parser.time();
+
+                job.timeMin = std::min(job.timeMin, time);
+                job.timeMax = std::max(job.timeMax, time);
+
+                // The values after a time reset are added as the next part
+                if (parser.timeResets() != stagingResets) {
+                    addStaged();
+                    stagingResets = parser.timeResets();
+                }
+
+                // Skip verbose values
+                if (skipped[parser.valueID()])
+                    continue;
+
+                staging.add(parser.valueID(), parser.valueType(), parser.rawValue(), time);
+                if (staging.size() >= DARTLOG_STAGING_VALUES)
+                    addStaged();
+            }
+        }
+
+    });
+    addStaged();
+    for (auto &series : plots)
+        finishSeries(series.second, plot_data);
+
+    // Remember where the log ended, to continue there on the next reload
+    if (resume) {
+        // Split series continue in the part of the last sample
+        for (auto &series : plots) {
+            if (_time_reset == DartlogTimeReset::Split && !series.second.isSkipped())
+                resume->series[series.first].part = series.second.currentPart();
+        }
+        resume->seriesNames.assign(tagNames.begin(), tagNames.end());
+        if (!complete || !resume->capture(input, parser))
+            resume->offset = 0;
+    }
+}
+
+void DataLoadDARTLog::loadBlocks(DartlogInput &input, DartlogParser &parser, PlotDataMapRef &plot_data, LoadJob &job) {
+    const std::vector<DartlogGzipBlock> &blocks = input.blocks();
+    qint64 headerSize = input.getPos();
+
+    // Every block has to be within the log and stored in a single chunk, the index is read from the file
+    std::vector<const char *> blockData(blocks.size());
+    for (size_t b = 0; b < blocks.size(); b++) {
+        qint64 start = qMax((qint64) blocks[b].offset, headerSize);
+        qint64 end = (qint64) (blocks[b].offset + blocks[b].size);
+        if (blocks[b].size <= DARTLOG_BUFFER_CHUNK_SIZE && end <= input.getSize() && end >= start)
+            blockData[b] = input.mapRange(start, end - start);
+        if (blockData[b] == nullptr) {
+            job.errors.append("Wrong block index read");
+            return;
+        }
+    }
+
+    // The tag table only changes in blocks defining tags, read those first to know the table at every block
+    std::vector<std::shared_ptr<const DartlogParserState>> states(blocks.size());
+    auto state = std::make_shared<const DartlogParserState>(parser.state());
+
+    auto openBlock = [&](size_t b, DartlogInput &blockInput, DartlogParser &blockParser) {
+        qint64 start = qMax((qint64) blocks[b].offset, headerSize);
+        qint64 size = (qint64) (blocks[b].offset + blocks[b].size) - start;
+        blockInput.openBuffer(blockData[b], size);
+
+        // Time resets are counted from the block start, the counts of the blocks before are added in order
+        DartlogParserState blockState = *states[b];
+        blockState.lastID = blocks[b].lastID;
+        blockState.time = blocks[b].time;
+        blockState.hasTime = b > 0;
+        blockState.timeResets = 0;
+        blockState.timeOffset = 0;
+        blockParser.setState(blockState);
+        blockParser.setOffsetTimeResets(_time_reset == DartlogTimeReset::Offset);
+    };
+
+    for (size_t b = 0; b < blocks.size(); b++) {
+        states[b] = state;
+        if ((blocks[b].flags & DARTLOG_GZIP_FLAG_DEFINES_TAGS) == 0)
+            continue;
+
+        DartlogInput blockInput;
+        DartlogParser blockParser(blockInput);
+        openBlock(b, blockInput, blockParser);
+
+        DartlogParser::Record record;
+        do {
+            record = blockParser.next();
+        } while (record == DartlogParser::Value || record == DartlogParser::TagDefinition);
+
+        state = std::make_shared<const DartlogParserState>(blockParser.state());
+    }
+
+    std::map<uint16_t, DartlogSeries> plots;
+    std::set<std::string> tagNames;
+    QString error;
+
+    // Time resets and offset of all blocks added so far
+    uint32_t resetsBefore = 0;
+    double offsetBefore = 0;
+
+    auto defineTag = [&](const DartlogTag &tag, uint32_t part) {
+        std::string name = makeSeriesName(tag, job.prefix, tagNames);
+        job.tagNames.push_back(tag.name);
 
-    return b[0] + b[1] * 256;
+        DartlogSeries &series = plots[tag.index];
+        finishSeries(series, plot_data);
+
+        if (tag.verbose && !job.loadVerboseData) {
+            series = DartlogSeries();
+            job.verboseSignalsIgnoredCount++;
+        }
+        else
+            series = makeSeries(plot_data, name, part);
+    };
+
+    auto pushValue = [&](DartlogSeries &series, const PlotData::Point &point, uint32_t part) {
+        double time = point.x + offsetBefore;
+        job.timeMin = std::min(job.timeMin, time);
+        job.timeMax = std::max(job.timeMax, time);
+        series.push(time, point.y, resetsBefore + part);
+    };
+
+    struct BlockValues {
+        // Columns by value ID, when splitting one staging per number of time resets in the block
+        std::vector<DartlogStaging> parts;
+        uint32_t timeResets = 0;
+        double timeOffset = 0;
+        QString error;
+    };
+    bool split = _time_reset == DartlogTimeReset::Split;
+
+    // Decode a window of blocks on all cores, then add the values in order on this thread
+    size_t windowSize = 4 * qMax(1u, std::thread::hardware_concurrency());
+    // A canceled load still finishes the series added so far
+    bool canceled = false;
+
+    for (size_t first = 0; first < blocks.size() && error.isEmpty() && !canceled; first += windowSize) {
+        size_t count = qMin(windowSize, blocks.size() - first);
+        std::vector<BlockValues> decoded(count);
+
+        parallelFor(count, [&](size_t i) {
+            size_t b = first + i;
+            if (blocks[b].flags & DARTLOG_GZIP_FLAG_DEFINES_TAGS)
+                return;
+
+            DartlogInput blockInput;
+            DartlogParser blockParser(blockInput);
+            openBlock(b, blockInput, blockParser);
+
+            std::vector<DartlogStaging> &parts = decoded[i].parts;
+            parts.resize(1);
+
+            dartlogDispatchVersion(blockParser.version(), [&](auto version) {
+                constexpr int Version = decltype(version)::value;
+
+                while (true) {
+                    DartlogParser::Record record = blockParser.next<Version>();
+                    if (record == DartlogParser::End)
+                        break;
+
+                    if (record != DartlogParser::Value) {
+                        decoded[i].error = record == DartlogParser::Error ? blockParser.errorString() : "Wrong block index read";
+                        break;
+                    }
+
+                    if (split && blockParser.timeResets() >= parts.size())
+                        parts.resize(blockParser.timeResets() + 1);
+                    DartlogStaging &staging = split ? parts[blockParser.timeResets()] : parts[0];
+                    staging.add(blockParser.valueID(), blockParser.valueType(), blockParser.rawValue(), blockParser.time());
+                }
+            });
+            for (DartlogStaging &staging : parts)
+                staging.convert();
+            decoded[i].timeResets = blockParser.timeResets();
+            decoded[i].timeOffset = blockParser.timeOffset();
+        });
+
+        for (size_t i = 0; i < count && error.isEmpty(); i++) {
+            size_t b = first + i;
+
+            if (!job.setValue(blocks[b].offset)) {
+                canceled = true;
+                break;
+            }
+
+            if (blocks[b].flags & DARTLOG_GZIP_FLAG_DEFINES_TAGS) {
+                DartlogInput blockInput;
+                DartlogParser blockParser(blockInput);
+                openBlock(b, blockInput, blockParser);
+
+                while (true) {
+                    DartlogParser::Record record = blockParser.next();
+                    if (record == DartlogParser::End)
+                        break;
+
+                    if (record == DartlogParser::Error) {
+                        error = blockParser.errorString();
+                        break;
+                    }
+
+                    if (record == DartlogParser::TagDefinition)
+                        defineTag(blockParser.tag(), resetsBefore + blockParser.timeResets());
+                    else {
+                        DartlogSeries &series = plots[blockParser.valueID()];
+                        if (!series.isSkipped())
+                            pushValue(series, PlotData::Point(blockParser.time(), blockParser.value()), blockParser.timeResets());
+                    }
+                }
+                resetsBefore += blockParser.timeResets();
+                offsetBefore += blockParser.timeOffset();
+                continue;
+            }
+
+            for (uint32_t part = 0; part < decoded[i].parts.size(); part++) {
+                const DartlogStaging &staging = decoded[i].parts[part];
+                const std::vector<double> &times = staging.times();
+                if (!times.empty()) {
+                    auto range = std::minmax_element(times.begin(), times.end());
+                    job.timeMin = std::min(job.timeMin, *range.first + offsetBefore);
+                    job.timeMax = std::max(job.timeMax, *range.second + offsetBefore);
+                }
+
+                for (uint32_t id : staging.keys()) {
+                    DartlogSeries &series = plots[(uint16_t) id];
+                    if (!series.isSkipped())
+                        series.push(*staging.column(id), times, offsetBefore, resetsBefore + part);
+                }
+            }
+            decoded[i].parts.clear();
+            resetsBefore += decoded[i].timeResets;
+            offsetBefore += decoded[i].timeOffset;
+            error = decoded[i].error;
+        }
+    }
+
+    for (auto &series : plots)
+        finishSeries(series.second, plot_data);
+
+    if (!error.isEmpty())
+        job.errors.append(error);
 }
 
-std::string DataLoadDARTLog::readString() {
-    std::string str = "";
-    while (!atEnd()) {
-        char c;
-        read(&c, sizeof(c));
-        if (c == 0)
-            return str;
-        str += c;
-    }
-    return str;
-}
\ No newline at end of file
+void DataLoadDARTLog::loadDartlog3(DartlogInput &input, FileLoadInfo *info, PlotDataMapRef &plot_data, LoadJob &job) {
+    const char *data;
+    qint64 size;
+    if (!input.mapAll(&data, &size)) {
+        job.errors.append("DARTLOG3 files can not be read from a stream");
+        return;
+    }
+
+    Dartlog3Reader reader(data, size);
+    if (!reader.readIndex()) {
+        job.errors.append(reader.errorString());
+        return;
+    }
+
+    const Dartlog3Index &index = reader.index();
+
+    // Only load the selected signals (all if none are selected) within the time window
+    std::unordered_set<std::string> selected(info->selected_datasources.begin(), info->selected_datasources.end());
+    std::set<std::string> tagNames;
+    std::vector<DartlogSeries> plots(index.columns.size());
+
+    struct BlockJob {
+        size_t column;
+        size_t block;
+    };
+    std::vector<BlockJob> jobs;
+    std::vector<bool> timeBlockNeeded(index.timeBlocks.size(), false);
+
+    for (size_t c = 0; c < index.columns.size(); c++) {
+        const Dartlog3Column &column = index.columns[c];
+        std::string name = makeSeriesName(column.tag, job.prefix, tagNames);
+
+        if (column.tag.verbose && !job.loadVerboseData) {
+            job.verboseSignalsIgnoredCount++;
+            continue;
+        }
+        if (!selected.empty() && selected.count(name) == 0)
+            continue;
+
+        plots[c] = makeSeries(plot_data, name);
+
+        for (size_t b = 0; b < column.blocks.size(); b++) {
+            const Dartlog3Block &timeBlock = index.timeBlocks[column.blocks[b].timeBlock];
+            if (timeBlock.timeMax < _time_window_start || timeBlock.timeMin > _time_window_end)
+                continue;
+
+            jobs.push_back({c, b});
+            timeBlockNeeded[column.blocks[b].timeBlock] = true;
+        }
+    }
+
+    // The time tag gives the offset after every reset, also when it was redefined
+    std::vector<const Dartlog3Column *> timeColumns;
+    if (_time_reset == DartlogTimeReset::Offset) {
+        for (const Dartlog3Column &column : index.columns) {
+            if (column.tag.name != "time")
+                continue;
+
+            timeColumns.push_back(&column);
+            for (const Dartlog3Block &block : column.blocks)
+                timeBlockNeeded[block.timeBlock] = true;
+        }
+    }
+
+    std::vector<size_t> timeJobs;
+    for (size_t i = 0; i < timeBlockNeeded.size(); i++) {
+        if (timeBlockNeeded[i])
+            timeJobs.push_back(i);
+    }
+
+    // Decompress all needed blocks on all cores
+    job.setRange(timeJobs.size() + jobs.size());
+    size_t blocksDoneBefore = 0;
+    auto progress = [&](size_t blocksDone) {
+        return job.setValue(blocksDoneBefore + blocksDone);
+    };
+
+    std::atomic<bool> failed(false);
+    std::vector<std::vector<double>> times(index.timeBlocks.size());
+    bool completed = parallelFor(timeJobs.size(), [&](size_t i) {
+        if (!reader.decodeTimeBlock(timeJobs[i], times[timeJobs[i]]))
+            failed = true;
+    }, progress);
+
+    blocksDoneBefore = timeJobs.size();
+    std::vector<std::vector<double>> values(jobs.size());
+    completed = completed && parallelFor(jobs.size(), [&](size_t i) {
+        if (!reader.decodeValueBlock(index.columns[jobs[i].column], jobs[i].block, values[i]))
+            failed = true;
+    }, progress);
+
+    if (!completed)
+        return;
+
+    if (failed)
+        job.errors.append("Could not decompress all blocks: data may be incomplete");
+
+    // First and last time of the time tag between two resets, by the number of resets before. Time blocks end
+    // at every reset and the columns of a redefined time tag follow each other.
+    std::map<uint32_t, std::pair<double, double>> resetTimes;
+    for (const Dartlog3Column *column : timeColumns) {
+        for (const Dartlog3Block &block : column->blocks) {
+            const std::vector<double> &blockTimes = times[block.timeBlock];
+            if (blockTimes.empty())
+                continue;
+
+            auto range = resetTimes.emplace(index.timeBlocks[block.timeBlock].timeResets,
+                                            std::make_pair(blockTimes.front(), blockTimes.back())).first;
+            range->second.second = blockTimes.back();
+        }
+    }
+
+    // Each reset adds the step back of the time tag, as the parser does
+    std::map<uint32_t, double> resetOffsets;
+    double offset = 0;
+    for (auto range = resetTimes.begin(); range != resetTimes.end(); ++range) {
+        if (range != resetTimes.begin())
+            offset += std::prev(range)->second.second - range->second.first;
+        resetOffsets[range->first] = offset;
+    }
+
+    // Series are only modified from this thread
+    for (size_t j = 0; j < jobs.size(); j++) {
+        const Dartlog3Block &block = index.columns[jobs[j].column].blocks[jobs[j].block];
+        const std::vector<double> &blockTimes = times[block.timeBlock];
+        const std::vector<double> &blockValues = values[j];
+        DartlogSeries &series = plots[jobs[j].column];
+
+        if (blockTimes.size() != blockValues.size())
+            continue;
+
+        // All samples of a block share the number of resets before them
+        uint32_t resets = index.timeBlocks[block.timeBlock].timeResets;
+        auto after = resetOffsets.upper_bound(resets);
+        double blockOffset = after == resetOffsets.begin() ? 0 : std::prev(after)->second;
+
+        for (size_t i = 0; i < blockValues.size(); i++) {
+            if (blockTimes[i] < _time_window_start || blockTimes[i] > _time_window_end)
+                continue;
+
+            series.push(blockTimes[i] + blockOffset, blockValues[i], resets);
+        }
+
+        values[j].clear();
+        values[j].shrink_to_fit();
+    }
+
+    for (DartlogSeries &series : plots)
+        finishSeries(series, plot_data);
+}
@@ -1,11 +1,32 @@
 #pragma once
 
+#include <QAction>
 #include <QObject>
 #include <QtPlugin>
+#include <QStringList>
+#include <qprogressdialog.h>
+#include <atomic>
+#include <cfloat>
+#include <map>
+#include <mutex>
+#include <set>
 #include "PlotJuggler/dataloader_base.h"
+#include "dartlog_input.h"
+#include "dartlog_parser.h"
+#include "dartlog_resume.h"
+#include "dartlog_series.h"
 
 using namespace PJ;
 
+// Extension of a list of logs loaded side by side, see loadFileList()
+#define DARTLOG_LIST_EXTENSION "dartlogs"
+// Line of a list marking its logs as segments of one log
+#define DARTLOG_LIST_SEGMENTS "@segments"
+// Decompressed bytes read from each segment to find its first time
+#define DARTLOG_SEGMENT_HEAD_SIZE (1024 * 1024)
+// Values staged by loadRecords() before they are converted and added to their series
+#define DARTLOG_STAGING_VALUES (1024 * 1024)
+
 class DataLoadDARTLog : public DataLoader {
     Q_OBJECT
     Q_PLUGIN_METADATA(IID "facontidavide.PlotJuggler3.DataLoader")
@@ -25,27 +46,105 @@ public:
         return "DARTLog Reader";
     }
 
+    bool xmlSaveState(QDomDocument &doc, QDomElement &parent_element) const override;
 
-protected:
-    QByteArray inputData;
-    QFile* inputFile;
-    qint64 pos;
+    bool xmlLoadState(const QDomElement &parent_element) override;
 
-    void close();
-    qint64 getPos();
-    qint64 getSize();
-    bool atEnd();
-    qint64 read(char* data, qint64 maxLen);
-    void skip(qint64 bytes);
-    uint8_t readUint8();
-    uint16_t readUint16();
+    const std::vector<QAction *> &availableActions() override;
 
-    std::string readString();
+protected:
+    /**
+     * @brief Loading of one file, on the GUI thread with a progress dialog or on a worker thread without one
+     */
+    struct LoadJob {
+        QString filename;
+        // Member of an archive to load instead of the file, filename is then its name in the archive
+        const DartlogArchive *archive = nullptr;
+        size_t member = 0;
+        std::string prefix;
+        QProgressDialog *dialog = nullptr;
+        const std::atomic<bool> *canceled = nullptr;
+        // Continues the log where it was loaded before instead of from the start, see canResume()
+        DartlogResume *resume = nullptr;
+
+        int version = 0;
+        bool loadVerboseData = false;
+        uint32_t verboseSignalsIgnoredCount = 0;
+        std::vector<std::string> tagNames;
+        double timeMin = DBL_MAX;
+        double timeMax = -DBL_MAX;
+        QStringList errors;
+
+        void setRange(qint64 maximum);
+        bool setValue(qint64 value);
+        double progress() const;
+
+    private:
+        std::atomic<qint64> progressValue{0};
+        std::atomic<qint64> progressMaximum{0};
+    };
+
+    void exportSubset();
+    void configureDecimation();
+    void createFileList();
+    void configureTimeReset();
+    bool incrementalReload() const;
+    bool canResume(const QString &filename) const;
+
+    bool loadFileList(PJ::FileLoadInfo *info, PlotDataMapRef &plot_data, QProgressDialog &progress_dialog);
+    bool loadArchive(PJ::FileLoadInfo *info, PlotDataMapRef &plot_data, QProgressDialog &progress_dialog);
+    bool loadJobs(std::vector<LoadJob> &jobs, PJ::FileLoadInfo *info, PlotDataMapRef &plot_data, QProgressDialog &progress_dialog);
+    bool loadSegments(const QStringList &filenames, PlotDataMapRef &plot_data, QProgressDialog &progress_dialog);
+    bool loadFile(LoadJob &job, PJ::FileLoadInfo *info, PlotDataMapRef &plot_data);
+
+    double decimationWidth(const std::string &seriesName) const;
+    DartlogSeries makeSeries(PlotDataMapRef &plot_data, const std::string &name, uint32_t part = 0);
+    void finishSeries(DartlogSeries &series, PlotDataMapRef &plot_data);
+
+    std::string makeSeriesName(const DartlogTag &tag, const std::string &prefix, std::set<std::string> &tagNames);
+
+    void loadRecords(DartlogInput &input, DartlogParser &parser, PlotDataMapRef &plot_data, LoadJob &job);
+    void loadBlocks(DartlogInput &input, DartlogParser &parser, PlotDataMapRef &plot_data, LoadJob &job);
+    void loadDartlog3(DartlogInput &input, PJ::FileLoadInfo *info, PlotDataMapRef &plot_data, LoadJob &job);
 
 private:
     std::vector<const char *> _extensions;
 
     std::string _default_time_axis;
-};
 
+    double _time_window_start;
+    double _time_window_end;
+
+    // Bucket width in seconds of the min/max decimation while loading, 0 loads every sample
+    double _decimation_width;
+    std::map<std::string, double> _decimation_signals;
+
+    // Only add samples changing the value, plus the edge points before the changes
+    bool _changes_only;
+    QAction *_changes_only_action;
+
+    // Min/max pyramid of every series as companion series dartlog_overview_<factor>/<series>
+    bool _overview;
+    QAction *_overview_action;
+
+    // Handling of the time going backwards within a log
+    DartlogTimeReset _time_reset;
+
+    // Reload only the data appended to a log since it was loaded, from a copy of the series loaded before
+    bool _incremental_reload;
+    QAction *_incremental_reload_action;
+    DartlogResume _resume;
+    PlotDataMapRef _resume_data;
+
+    std::vector<QAction *> _actions;
+
+    // Series are created by one file at a time when loading files in parallel
+    std::mutex _series_mutex;
+
+    // Last loaded DARTLOG or DARTLOG2 file, offered by "Export subset"
+    QString _last_filename;
+    std::vector<std::string> _last_tag_names;
+    double _last_time_min;
+    double _last_time_max;
+};
 
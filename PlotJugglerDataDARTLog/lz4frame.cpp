@@ -0,0 +1,439 @@
+#include "lz4frame.h"
+
+#include "dartlog_parallel.h"
+
+#include <atomic>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+quint32 readLE32(const uchar* p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((quint32)p[3] << 24);
+}
+
+/**
+ * @brief Decompresses a single LZ4 block
+ * @param src The compressed block
+ * @param srcSize The size of the compressed block
+ * @param dst Where the decompressed data is written to
+ * @param dstCapacity The maximum size of the decompressed block
+ * @param prefixStart Start of the already decoded data matches may refer to (@c dst for independent blocks)
+ * @return The number of decompressed bytes or @c -1 if the block is malformed
+ */
+qint64 decompressBlock(const uchar* src, qint64 srcSize, uchar* dst, qint64 dstCapacity, const uchar* prefixStart)
+{
+    const uchar* ip = src;
+    const uchar* const iend = src + srcSize;
+    uchar* op = dst;
+    uchar* const oend = dst + dstCapacity;
+
+    while (ip < iend) {
+        unsigned token = *ip++;
+
+        // Copy literals
+        qint64 literalLength = token >> 4;
+        if (literalLength == 15) {
+            uchar b;
+            do {
+                if (ip >= iend)
+                    return -1;
+                b = *ip++;
+                literalLength += b;
+            } while (b == 255);
+        }
+
+        if (literalLength > iend - ip || literalLength > oend - op)
+            return -1;
+
+        memcpy(op, ip, literalLength);
+        ip += literalLength;
+        op += literalLength;
+
+        // The last sequence of a block only contains literals
+        if (ip >= iend)
+            break;
+
+        // Copy match
+        if (iend - ip < 2)
+            return -1;
+
+        qint64 offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        if (offset == 0 || offset > op - prefixStart)
+            return -1;
+
+        qint64 matchLength = token & 15;
+        if (matchLength == 15) {
+            uchar b;
+            do {
+                if (ip >= iend)
+                    return -1;
+                b = *ip++;
+                matchLength += b;
+            } while (b == 255);
+        }
+        matchLength += 4;
+
+        if (matchLength > oend - op)
+            return -1;
+
+        const uchar* match = op - offset;
+        if (offset >= matchLength) {
+            memcpy(op, match, matchLength);
+            op += matchLength;
+        }
+        else {
+            // Overlapping match: repeats the last offset bytes
+            for (qint64 i = 0; i < matchLength; i++)
+                *op++ = *match++;
+        }
+    }
+
+    return op - dst;
+}
+
+}
+
+struct LZ4Block
+{
+    const uchar* data;
+    quint32 size;
+    quint32 maxSize;
+    bool compressed;
+    bool independent;
+    bool newFrame;
+};
+
+/**
+ * @brief Walks over the blocks of one or more concatenated LZ4 frames without decompressing them
+ */
+class LZ4FrameParser
+{
+public:
+    enum Result { Block, End, Error };
+
+    LZ4FrameParser(const uchar* data, qint64 size)
+        : data(data), size(size), pos(0), inFrame(false), newFrame(false),
+          independent(false), blockChecksum(false), contentChecksum(false), blockMaxSize(0)
+    {
+    }
+
+    Result next(LZ4Block& block)
+    {
+        while (true) {
+            if (!inFrame) {
+                if (pos >= size)
+                    return End;
+                if (size - pos < 4)
+                    return Error;
+
+                quint32 magic = readLE32(data + pos);
+
+                // Skippable frames may contain arbitrary user data
+                if ((magic & LZ4_SKIPPABLE_MAGIC_MASK) == LZ4_SKIPPABLE_MAGIC) {
+                    if (size - pos < 8)
+                        return Error;
+                    quint32 length = readLE32(data + pos + 4);
+                    pos += 8;
+                    if (length > size - pos)
+                        return Error;
+                    pos += length;
+                    continue;
+                }
+
+                if (magic != LZ4_FRAME_MAGIC || size - pos < 7)
+                    return Error;
+                pos += 4;
+
+                uchar flags = data[pos];
+                uchar blockDescriptor = data[pos + 1];
+                if ((flags >> 6) != 1)
+                    return Error;
+
+                independent = (flags & 0x20) != 0;
+                blockChecksum = (flags & 0x10) != 0;
+                bool hasContentSize = (flags & 0x08) != 0;
+                contentChecksum = (flags & 0x04) != 0;
+                bool hasDictionary = (flags & 0x01) != 0;
+
+                // Dictionaries are never written by the logger
+                if (hasDictionary)
+                    return Error;
+
+                int maxSizeCode = (blockDescriptor >> 4) & 0x07;
+                if (maxSizeCode < 4)
+                    return Error;
+                blockMaxSize = 1u << (8 + 2 * maxSizeCode);
+
+                // Flags, block descriptor, optional content size and header checksum
+                qint64 headerSize = 2 + (hasContentSize ? 8 : 0) + 1;
+                if (size - pos < headerSize)
+                    return Error;
+                pos += headerSize;
+
+                inFrame = true;
+                newFrame = true;
+            }
+
+            if (size - pos < 4)
+                return Error;
+            quint32 blockSize = readLE32(data + pos);
+            pos += 4;
+
+            // End mark of the frame
+            if (blockSize == 0) {
+                inFrame = false;
+                if (contentChecksum) {
+                    if (size - pos < 4)
+                        return Error;
+                    pos += 4;
+                }
+                continue;
+            }
+
+            block.compressed = (blockSize & 0x80000000) == 0;
+            block.size = blockSize & 0x7FFFFFFF;
+            block.maxSize = blockMaxSize;
+            block.independent = independent;
+            block.newFrame = newFrame;
+            block.data = data + pos;
+
+            qint64 blockEnd = (qint64)block.size + (blockChecksum ? 4 : 0);
+            if (block.size > blockMaxSize || blockEnd > size - pos)
+                return Error;
+
+            pos += blockEnd;
+            newFrame = false;
+            return Block;
+        }
+    }
+
+    qint64 getPos() const
+    {
+        return pos;
+    }
+
+    qint64 getSize() const
+    {
+        return size;
+    }
+
+private:
+    const uchar* data;
+    qint64 size;
+    qint64 pos;
+    bool inFrame;
+    bool newFrame;
+    bool independent;
+    bool blockChecksum;
+    bool contentChecksum;
+    quint32 blockMaxSize;
+};
+
+/**
+ * @brief Checks if the given data starts with a LZ4 frame
+ * @param header At least the first four bytes of the data
+ * @return @c true if the LZ4 frame magic number was found, @c false otherwise
+ */
+bool LZ4Frame::hasMagic(const QByteArray& header)
+{
+    if (header.size() < 4)
+        return false;
+    return readLE32((const uchar*)header.constData()) == LZ4_FRAME_MAGIC;
+}
+
+/**
+ * @brief Checks if all frames of the given data use independent blocks
+ * @param input The compressed data
+ * @param size Size of the compressed data in bytes
+ * @return @c true if every block can be decompressed on its own, @c false otherwise
+ */
+bool LZ4Frame::hasIndependentBlocks(const char* input, qint64 size)
+{
+    LZ4FrameParser parser((const uchar*)input, size);
+    LZ4Block block;
+
+    LZ4FrameParser::Result result;
+    while ((result = parser.next(block)) == LZ4FrameParser::Block) {
+        if (!block.independent)
+            return false;
+    }
+    return result == LZ4FrameParser::End;
+}
+
+/**
+ * @brief Decompresses the given LZ4 frame(s); independent blocks are decompressed in parallel
+ * @param input The buffer to be decompressed
+ * @param size Size of the buffer in bytes
+ * @param output The result of the decompression, in chunks of the log size
+ * @param dialog Optional dialog to report progress to and to cancel the decompression
+ * @return @c true if the decompression was successful, @c false otherwise
+ */
+bool LZ4Frame::decompress(const char* input, qint64 size, DartlogBuffer& output, QProgressDialog* dialog)
+{
+    // Prepare output
+    output.clear();
+
+    // Progress in KB, the size may exceed the int range of the dialog
+    if (dialog) {
+        dialog->setRange(0, (int)(size / 1024));
+        dialog->setValue(0);
+        QApplication::processEvents();
+    }
+
+    // Linked blocks depend on each other and can only be decoded in order
+    if (!hasIndependentBlocks(input, size)) {
+        LZ4FrameStream stream(input, size);
+        QByteArray block;
+        int dialogUpdateCount = 0;
+
+        while (stream.readBlock(block)) {
+            output.append(block.constData(), block.size());
+
+            dialogUpdateCount++;
+            if (dialog && dialogUpdateCount % 16 == 0) {
+                dialog->setValue((int)(stream.pos() / 1024));
+                QApplication::processEvents();
+
+                if (dialog->wasCanceled())
+                    return false;
+            }
+        }
+        output.finish();
+        return !stream.hasError();
+    }
+
+    // Collect all blocks
+    LZ4FrameParser parser((const uchar*)input, size);
+    std::vector<LZ4Block> blocks;
+    LZ4Block block;
+    while (parser.next(block) == LZ4FrameParser::Block)
+        blocks.push_back(block);
+
+    // Decompress blocks on all cores
+    std::vector<QByteArray> decoded(blocks.size());
+    std::atomic<bool> failed(false);
+
+    auto decompressJob = [&](size_t i) {
+        const LZ4Block& b = blocks[i];
+        QByteArray& out = decoded[i];
+        out.resize(b.maxSize);
+
+        qint64 have;
+        if (b.compressed)
+            have = decompressBlock(b.data, b.size, (uchar*)out.data(), b.maxSize, (uchar*)out.data());
+        else {
+            memcpy(out.data(), b.data, b.size);
+            have = b.size;
+        }
+
+        if (have < 0) {
+            failed = true;
+            have = 0;
+        }
+        out.resize(have);
+    };
+
+    std::function<bool(size_t)> progress;
+    if (dialog) {
+        dialog->setRange(0, (int)blocks.size());
+        progress = [dialog](size_t blocksDone) {
+            dialog->setValue((int)blocksDone);
+            QApplication::processEvents();
+            return !dialog->wasCanceled();
+        };
+    }
+
+    if (!parallelFor(blocks.size(), decompressJob, progress))
+        return false;
+
+    // Join blocks into chunks, presized to the total
+    qint64 total = 0;
+    for (const QByteArray& b : decoded)
+        total += b.size();
+
+    for (QByteArray& b : decoded) {
+        output.append(b.constData(), b.size(), total);
+        total -= b.size();
+        b.clear();
+    }
+    output.finish();
+
+    return !failed && parser.getPos() == parser.getSize();
+}
+
+LZ4FrameStream::LZ4FrameStream(const char* input, qint64 size)
+    : parser(new LZ4FrameParser((const uchar*)input, size)),
+      windowUsed(0),
+      error(false)
+{
+}
+
+LZ4FrameStream::~LZ4FrameStream() = default;
+
+/**
+ * @brief Decompresses the next block of the frame
+ * @param block The decompressed data of the block
+ * @return @c true if a block was read, @c false at the end of the data or on errors
+ */
+bool LZ4FrameStream::readBlock(QByteArray& block)
+{
+    if (error)
+        return false;
+
+    LZ4Block b;
+    LZ4FrameParser::Result result = parser->next(b);
+    if (result != LZ4FrameParser::Block) {
+        error = result == LZ4FrameParser::Error;
+        return false;
+    }
+
+    // Keep the last 64 KB of decoded data for linked blocks
+    qint64 historySize = 0;
+    if (!b.newFrame && !b.independent)
+        historySize = qMin((qint64)LZ4_MAX_DISTANCE, windowUsed);
+
+    if (window.size() < LZ4_MAX_DISTANCE + (qint64)b.maxSize)
+        window.resize(LZ4_MAX_DISTANCE + b.maxSize);
+
+    if (historySize > 0)
+        memmove(window.data(), window.data() + windowUsed - historySize, historySize);
+
+    uchar* windowStart = (uchar*)window.data();
+    uchar* dst = windowStart + historySize;
+
+    qint64 have;
+    if (b.compressed)
+        have = decompressBlock(b.data, b.size, dst, b.maxSize, windowStart);
+    else {
+        memcpy(dst, b.data, b.size);
+        have = b.size;
+    }
+
+    if (have < 0) {
+        error = true;
+        return false;
+    }
+
+    windowUsed = historySize + have;
+    block = QByteArray((const char*)dst, (int)have);
+    return true;
+}
+
+bool LZ4FrameStream::hasError() const
+{
+    return error;
+}
+
+qint64 LZ4FrameStream::pos() const
+{
+    return parser->getPos();
+}
+
+qint64 LZ4FrameStream::size() const
+{
+    return parser->getSize();
+}
@@ -0,0 +1,50 @@
+#ifndef LZ4FRAME_H
+#define LZ4FRAME_H
+
+#include <QByteArray>
+#include <qprogressdialog.h>
+#include <QApplication>
+#include <memory>
+
+#include "dartlog_buffer.h"
+
+#define LZ4_FRAME_MAGIC 0x184D2204
+#define LZ4_SKIPPABLE_MAGIC 0x184D2A50
+#define LZ4_SKIPPABLE_MAGIC_MASK 0xFFFFFFF0
+#define LZ4_MAX_DISTANCE (64 * 1024)
+
+class LZ4FrameParser;
+
+class LZ4Frame
+{
+public:
+    static bool hasMagic(const QByteArray& header);
+    static bool hasIndependentBlocks(const char* input, qint64 size);
+    static bool decompress(const char* input, qint64 size, DartlogBuffer& output, QProgressDialog* dialog);
+};
+
+/**
+ * @brief Decodes a LZ4 frame block by block, keeping only the history window
+ * required for linked blocks in memory
+ *
+ * The compressed data is not copied, it has to stay valid while the stream is read.
+ */
+class LZ4FrameStream
+{
+public:
+    LZ4FrameStream(const char* input, qint64 size);
+    ~LZ4FrameStream();
+
+    bool readBlock(QByteArray& block);
+    bool hasError() const;
+    qint64 pos() const;
+    qint64 size() const;
+
+private:
+    std::unique_ptr<LZ4FrameParser> parser;
+    QByteArray window;
+    qint64 windowUsed;
+    bool error;
+};
+
+#endif // LZ4FRAME_H
@@ -1,4 +1,8 @@
 #include "qcompressor.h"
+#include "dartlog_parallel.h"
+#include <atomic>
+#include <cstring>
+#include <vector>
 
 /**
  * @brief Compresses the given buffer using the standard GZIP algorithm
@@ -100,119 +104,371 @@ bool QCompressor::gzipCompress(QByteArray input, QByteArray& output, int level)
 }
 
 /**
- * @brief Decompresses the given buffer using the standard GZIP algorithm
- * @param input The buffer to be decompressed
- * @param output The result of the decompression
- * @return @c true if the decompression was successfull, @c false otherwise
+ * @brief Compresses the given buffer on all cores into independent GZIP members of a fixed size (like pigz)
+ *
+ * The members are simply concatenated, so the result is a valid multi-member GZIP file.
+ * @param input The buffer to be compressed
+ * @param output The result of the compression
+ * @param memberSize Number of uncompressed bytes per member
+ * @param level The compression level to be used (@c 0 = no compression, @c 9 = max, @c -1 = default)
+ * @return @c true if the compression was successful, @c false otherwise
  */
-bool QCompressor::gzipDecompress(QByteArray input, QByteArray& output, QProgressDialog* dialog)
+bool QCompressor::gzipCompressMembers(const QByteArray& input, QByteArray& output, int memberSize, int level)
 {
     // Prepare output
     output.clear();
 
-    dialog->setRange(0, input.length());
-    dialog->setValue(0);
-    QApplication::processEvents();
+    size_t memberCount = (input.size() + memberSize - 1) / memberSize;
+    std::vector<QByteArray> members(memberCount);
+    std::atomic<bool> failed(false);
 
-    // Is there something to do?
-    if (input.length() > 0)
-    {
-        // Prepare inflater status
-        z_stream strm;
-        strm.zalloc = Z_NULL;
-        strm.zfree = Z_NULL;
-        strm.opaque = Z_NULL;
-        strm.avail_in = 0;
-        strm.next_in = Z_NULL;
+    parallelFor(memberCount, [&](size_t i) {
+        if (!gzipCompress(input.mid(int(i) * memberSize, memberSize), members[i], level))
+            failed = true;
+    });
 
-        // Initialize inflater
-        int ret = inflateInit2(&strm, GZIP_WINDOWS_BIT);
+    if (failed)
+        return(false);
 
-        if (ret != Z_OK)
-            return(false);
+    // Cumulate result in order
+    for (const QByteArray& member : members)
+        output.append(member);
 
-        // Extract pointer to input data
-        char* input_data = input.data();
-        int input_data_left = input.length();
-        int pos = 0;
-        int dialogUpdateCount = 0;
+    return(true);
+}
 
-        // Decompress data until available
-        do {
-            // Determine current chunk size
-            int chunk_size = qMin(GZIP_CHUNK_SIZE, input_data_left);
+/**
+ * @brief Inflate stream of the calling thread, reset for every use instead of allocating a new one
+ * @return @c nullptr if the stream could not be initialized
+ */
+static z_stream* pooledInflateStream()
+{
+    struct InflateStream {
+        z_stream strm;
+        bool initialized;
+
+        InflateStream()
+        {
+            strm.zalloc = Z_NULL;
+            strm.zfree = Z_NULL;
+            strm.opaque = Z_NULL;
+            strm.avail_in = 0;
+            strm.next_in = Z_NULL;
+            initialized = inflateInit2(&strm, GZIP_WINDOWS_BIT) == Z_OK;
+        }
+
+        ~InflateStream()
+        {
+            if (initialized)
+                inflateEnd(&strm);
+        }
+    };
+
+    thread_local InflateStream stream;
+
+    // Also back to gzip after a use for raw deflate
+    if (!stream.initialized || inflateReset2(&stream.strm, GZIP_WINDOWS_BIT) != Z_OK)
+        return(nullptr);
+
+    // Forget the buffers of the last use
+    stream.strm.next_in = Z_NULL;
+    stream.strm.avail_in = 0;
+    stream.strm.next_out = Z_NULL;
+    stream.strm.avail_out = 0;
+    return(&stream.strm);
+}
 
-            // Check for termination
-            if (chunk_size <= 0)
-                break;
+/**
+ * @brief Reads the uncompressed size from the trailer (ISIZE) of the last GZIP member
+ *
+ * ISIZE is only the size modulo 2^32 of the last member, so the result is a hint for
+ * sizing the output: multi-member files and files over 4 GB are larger.
+ * @return The size, @c 0 if the input is too short
+ */
+qint64 QCompressor::gzipSize(const char* input, qint64 size)
+{
+    if (size < 18)
+        return(0);
 
-            // Set inflater references
-            strm.next_in = (unsigned char*)input_data;
-            strm.avail_in = chunk_size;
+    const uchar* trailer = (const uchar*)input + size - 4;
+    return(trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | ((quint32)trailer[3] << 24));
+}
 
-            // Update interval variables
-            input_data += chunk_size;
-            input_data_left -= chunk_size;
-            pos += chunk_size;
+/**
+ * @brief Inflates GZIP data into the output, from the start or from an access point, see gzipDecompress()
+ */
+static bool inflateGzip(const char* input, qint64 size, const GzipAccessPoint* start, DartlogBuffer& output,
+                        QProgressDialog* dialog, std::vector<GzipAccessPoint>* points)
+{
+    if (dialog) {
+        dialog->setRange(0, 1000);
+        dialog->setValue(0);
+        QApplication::processEvents();
+    }
 
-            // Inflate chunk and cumulate output
-            do {
+    // Is there something to do?
+    if (size <= 0)
+        return(true);
 
-                // Declare vars
-                char out[GZIP_CHUNK_SIZE];
+    z_stream* strm = pooledInflateStream();
+    if (strm == nullptr)
+        return(false);
+
+    qint64 expectedSize = QCompressor::gzipSize(input, size);
+    qint64 pos = 0;
+    // Decompressed offset of the start of the output
+    qint64 base = 0;
+    // Inflating raw deflate data within a member, continued from an access point
+    bool raw = false;
+
+    if (start != nullptr) {
+        // The output starts with the history, so later access points find theirs in it
+        base = start->out - start->window.size();
+        for (qint64 done = 0; done < start->window.size();) {
+            qint64 available;
+            char* out = output.reserve(0, &available);
+            qint64 n = qMin<qint64>(available, start->window.size() - done);
+            memcpy(out, start->window.constData() + done, n);
+            output.commit(n);
+            done += n;
+        }
+
+        pos = start->in;
+        expectedSize = 0;
+        if (!start->memberStart) {
+            raw = true;
+            if (inflateReset2(strm, -MAX_WBITS) != Z_OK
+                || (start->bits > 0 && inflatePrime(strm, start->bits, (uchar)input[start->in - 1] >> (8 - start->bits)) != Z_OK)
+                || inflateSetDictionary(strm, (const Bytef*)start->window.constData(), (uInt)start->window.size()) != Z_OK)
+                return(false);
+        }
+    }
 
-                // Set inflater references
-                strm.next_out = (unsigned char*)out;
-                strm.avail_out = GZIP_CHUNK_SIZE;
+    // Access points are found by stopping at every deflate block
+    int flush = points != nullptr ? Z_BLOCK : Z_NO_FLUSH;
+    auto addPoint = [&](bool memberStart) {
+        GzipAccessPoint point;
+        point.in = pos - strm->avail_in;
+        point.bits = memberStart ? 0 : strm->data_type & 7;
+        point.out = base + output.size();
+        point.memberStart = memberStart;
+        if (points->empty() || point.out > points->back().out || memberStart)
+            points->push_back(point);
+    };
+    if (points != nullptr && raw) {
+        // Continued within a member, the start is the first access point (its window is in the output)
+        points->push_back(*start);
+        points->back().window.clear();
+    }
+    else if (points != nullptr)
+        addPoint(true);
 
-                // Try to inflate chunk
-                ret = inflate(&strm, Z_NO_FLUSH);
+    int ret = Z_OK;
 
-                switch (ret) {
-                case Z_NEED_DICT:
-                    ret = Z_DATA_ERROR;
-                case Z_DATA_ERROR:
-                case Z_MEM_ERROR:
-                case Z_STREAM_ERROR:
-                    // Clean-up
-                    inflateEnd(&strm);
+    // Decompress data until available
+    while (true) {
+        // Feed the next chunk of input
+        if (strm->avail_in == 0) {
+            if (pos >= size)
+                break;
 
-                    // Return
-                    return(false);
-                }
+            strm->next_in = (unsigned char*)input + pos;
+            strm->avail_in = (uInt)qMin<qint64>(GZIP_INPUT_CHUNK_SIZE, size - pos);
+            pos += strm->avail_in;
+
+            if (dialog) {
+                dialog->setValue((int)(pos * 1000 / size));
+                QApplication::processEvents();
+
+                // Stop decompression
+                if (dialog->wasCanceled())
+                    break;
+            }
+        }
+
+        // Inflate directly into the output
+        qint64 available;
+        char* out = output.reserve(expectedSize - output.size(), &available);
+        strm->next_out = (unsigned char*)out;
+        strm->avail_out = (uInt)available;
+
+        ret = inflate(strm, flush);
+        output.commit(available - strm->avail_out);
+
+        if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR || ret == Z_STREAM_ERROR)
+            break;
+
+        // Between two blocks, but not after the last one of a member
+        if (points != nullptr && ret == Z_OK && (strm->data_type & 128) && !(strm->data_type & 64))
+            addPoint(false);
+
+        // Continue with the next member of a multi-member file
+        if (ret == Z_STREAM_END) {
+            if (raw) {
+                // Skip the trailer of the member inflated raw, then continue as gzip
+                pos = qMin(pos - strm->avail_in + 8, size);
+                strm->next_in = Z_NULL;
+                strm->avail_in = 0;
+                raw = false;
+                if (inflateReset2(strm, GZIP_WINDOWS_BIT) != Z_OK || pos >= size)
+                    break;
+            }
+            else {
+                if (strm->avail_in == 0 && pos >= size)
+                    break;
+                inflateReset(strm);
+            }
+
+            if (points != nullptr)
+                addPoint(true);
+        }
+    }
 
-                // Determine decompressed size
-                int have = (GZIP_CHUNK_SIZE - strm.avail_out);
+    output.finish();
 
-                // Cumulate result
-                if (have > 0)
-                    output.append((char*)out, have);
+    // Return
+    return(ret == Z_STREAM_END);
+}
+
+/**
+ * @brief Decompresses the given buffer using the standard GZIP algorithm, including all members of multi-member files
+ *
+ * The output is sized once by gzipSize() and inflated into directly, without intermediate copies.
+ * @param input The buffer to be decompressed, e.g. the memory mapped file
+ * @param size Size of the buffer in bytes
+ * @param output The result of the decompression, in chunks so it may exceed 2 GB
+ * @param dialog Optional dialog to report progress to and to cancel the decompression
+ * @param points Optionally receives an access point at every deflate block and member, in order (without their windows)
+ * @return @c true if the decompression was successfull, @c false otherwise (@p output then holds the data up to the error)
+ */
+bool QCompressor::gzipDecompress(const char* input, qint64 size, DartlogBuffer& output, QProgressDialog* dialog,
+                                 std::vector<GzipAccessPoint>* points)
+{
+    // Prepare output
+    output.clear();
+    return(inflateGzip(input, size, nullptr, output, dialog, points));
+}
+
+/**
+ * @brief Continues decompressing at an access point, e.g. to decompress only the data appended to a log since
+ * @param point Access point found by gzipDecompress(), with its window unless it is the start of a member
+ * @param output Receives the window of the point followed by all data after it
+ * @return As gzipDecompress(), which also gives the access points
+ */
+bool QCompressor::gzipDecompressFrom(const char* input, qint64 size, const GzipAccessPoint& point, DartlogBuffer& output,
+                                     QProgressDialog* dialog, std::vector<GzipAccessPoint>* points)
+{
+    output.clear();
+    if (point.in > size || (point.bits > 0 && point.in == 0))
+        return(false);
+    return(inflateGzip(input, size, &point, output, dialog, points));
+}
 
-                dialogUpdateCount++;
-                if (dialogUpdateCount % 100 == 0) {
-                    dialog->setValue(pos);
-                    QApplication::processEvents();
+/**
+ * @brief Decompresses GZIP data of a known uncompressed size into the given buffer
+ * @param input The buffer to be decompressed
+ * @param size Size of the buffer in bytes
+ * @param output The buffer to decompress into
+ * @param outputSize The exact uncompressed size
+ * @return @c true if the data decompressed to exactly @p outputSize bytes, @c false otherwise
+ */
+bool QCompressor::gzipDecompress(const char* input, qint64 size, char* output, qint64 outputSize)
+{
+    z_stream* strm = pooledInflateStream();
+    if (strm == nullptr)
+        return(false);
 
-                    // Stop decompression
-                    if (dialog->wasCanceled()) {
-                        // Clean-up
-                        inflateEnd(&strm);
+    strm->next_in = (unsigned char*)input;
+    strm->avail_in = (uInt)size;
+    strm->next_out = (unsigned char*)output;
+    strm->avail_out = (uInt)outputSize;
 
-                        // Return
-                        return(false);
-                    }
-                }
+    int ret = inflate(strm, Z_FINISH);
 
-            } while (strm.avail_out == 0);
+    return(ret == Z_STREAM_END && (qint64)strm->total_out == outputSize);
+}
 
-        } while (ret != Z_STREAM_END);
+/**
+ * @brief Decompresses only the start of GZIP data, e.g. to read the first records of a log
+ * @param input The buffer to be decompressed, may be cut off
+ * @param size Size of the buffer in bytes
+ * @param output The buffer to decompress into
+ * @param outputSize Size of the output buffer, decompression stops once it is full
+ * @return Number of bytes decompressed, @c -1 on errors
+ */
+qint64 QCompressor::gzipDecompressHead(const char* input, qint64 size, char* output, qint64 outputSize)
+{
+    z_stream* strm = pooledInflateStream();
+    if (strm == nullptr)
+        return(-1);
+
+    strm->next_in = (unsigned char*)input;
+    strm->avail_in = (uInt)size;
+    strm->next_out = (unsigned char*)output;
+    strm->avail_out = (uInt)outputSize;
+
+    // Continue with the next member until the output is full or the input is used up
+    int ret;
+    do {
+        ret = inflate(strm, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END && strm->avail_in > 0)
+            ret = inflateReset(strm);
+    } while (ret == Z_OK && strm->avail_out > 0 && strm->avail_in > 0);
+
+    if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+        return(-1);
+    return(outputSize - strm->avail_out);
+}
 
-        // Clean-up
-        inflateEnd(&strm);
+/**
+ * @brief Decompresses raw deflate data without gzip header of a known uncompressed size, e.g. a member of a zip archive
+ * @param input The buffer to be decompressed
+ * @param size Size of the buffer in bytes
+ * @param output The result of the decompression, in chunks of the log size
+ * @param outputSize The exact uncompressed size
+ * @return @c true if the data decompressed to exactly @p outputSize bytes, @c false otherwise
+ */
+bool QCompressor::inflateRaw(const char* input, qint64 size, DartlogBuffer& output, qint64 outputSize)
+{
+    output.clear();
 
-        // Return
-        return (ret == Z_STREAM_END);
+    z_stream strm;
+    strm.zalloc = Z_NULL;
+    strm.zfree = Z_NULL;
+    strm.opaque = Z_NULL;
+    strm.avail_in = 0;
+    strm.next_in = Z_NULL;
+
+    // Negative window bits: no header and trailer
+    if (inflateInit2(&strm, -MAX_WBITS) != Z_OK)
+        return(false);
+
+    // Fed in pieces, members may exceed the 32 bit sizes of zlib
+    qint64 pos = 0;
+    qint64 done = 0;
+    int ret = Z_OK;
+    while (ret == Z_OK) {
+        if (strm.avail_in == 0 && pos < size) {
+            strm.next_in = (unsigned char*)input + pos;
+            strm.avail_in = (uInt)qMin<qint64>(GZIP_INPUT_CHUNK_SIZE, size - pos);
+            pos += strm.avail_in;
+        }
+
+        qint64 space;
+        strm.next_out = (unsigned char*)output.reserve(outputSize - done, &space);
+        strm.avail_out = (uInt)qMin<qint64>(GZIP_INPUT_CHUNK_SIZE, qMin(space, outputSize - done));
+        uInt available = strm.avail_out;
+
+        ret = inflate(&strm, Z_NO_FLUSH);
+        output.commit(available - strm.avail_out);
+        done += available - strm.avail_out;
+
+        // No progress possible: input used up or output full before the end of the stream
+        if (ret == Z_BUF_ERROR || (ret == Z_OK && available == 0))
+            break;
     }
-    else
-        return(true);
-}
\ No newline at end of file
+    output.finish();
+
+    inflateEnd(&strm);
+    return(ret == Z_STREAM_END && done == outputSize);
+}
@@ -5,15 +5,45 @@
 #include <QByteArray>
 #include <qprogressdialog.h>
 #include <QApplication>
+#include <vector>
 
-#define GZIP_WINDOWS_BIT 15 + 16
-#define GZIP_CHUNK_SIZE 32 * 1024
+#include "dartlog_buffer.h"
+
+#define GZIP_WINDOWS_BIT (15 + 16)
+#define GZIP_CHUNK_SIZE (32 * 1024)
+// Compressed bytes inflated between progress updates
+#define GZIP_INPUT_CHUNK_SIZE (1024 * 1024)
+// History deflate refers back to at most
+#define GZIP_WINDOW_SIZE (32 * 1024)
+
+/**
+ * @brief Position in a GZIP stream to continue inflating at, without the data before it (as zlib's zran.c)
+ */
+struct GzipAccessPoint {
+    // Compressed offset of the next full byte, and the bits of the byte before still to be inflated
+    qint64 in = 0;
+    int bits = 0;
+    // Decompressed offset
+    qint64 out = 0;
+    // At the start of a member, which needs no history
+    bool memberStart = true;
+    // Up to GZIP_WINDOW_SIZE decompressed bytes before out, the history of the inflater
+    QByteArray window;
+};
 
 class QCompressor
 {
 public:
     static bool gzipCompress(QByteArray input, QByteArray& output, int level = -1);
-    static bool gzipDecompress(QByteArray input, QByteArray& output, QProgressDialog* dialog);
+    static bool gzipCompressMembers(const QByteArray& input, QByteArray& output, int memberSize, int level = -1);
+    static qint64 gzipSize(const char* input, qint64 size);
+    static bool gzipDecompress(const char* input, qint64 size, DartlogBuffer& output, QProgressDialog* dialog,
+                               std::vector<GzipAccessPoint>* points = nullptr);
+    static bool gzipDecompressFrom(const char* input, qint64 size, const GzipAccessPoint& point, DartlogBuffer& output,
+                                   QProgressDialog* dialog, std::vector<GzipAccessPoint>* points = nullptr);
+    static bool gzipDecompress(const char* input, qint64 size, char* output, qint64 outputSize);
+    static qint64 gzipDecompressHead(const char* input, qint64 size, char* output, qint64 outputSize);
+    static bool inflateRaw(const char* input, qint64 size, DartlogBuffer& output, qint64 outputSize);
 };
 
 #endif // QCOMPRESSOR_H
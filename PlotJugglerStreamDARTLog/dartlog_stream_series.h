@@ -0,0 +1,74 @@
+#pragma once
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "PlotJuggler/plotdata.h"
+#include "dartlog_format.h"
+#include "dartlog_staging.h"
+
+/**
+ * @brief Series of the tags of a stream, added to the data map of a streamer a batch at a time
+ *
+ * Series names are kept per tag ID and looked up per batch, as the series may be cleared meanwhile. A tag
+ * redefined with the same name and unit, e.g. by a restarted producer, continues its series.
+ */
+class DartlogStreamSeries {
+public:
+    void clear() {
+        series.clear();
+        seriesNames.clear();
+        tagNames.clear();
+    }
+
+    /**
+     * @brief Name of the series of a tag, given once per tag name and unit
+     */
+    const std::string &seriesName(const DartlogTag &tag) {
+        std::string key = tag.name + '\0' + tag.unit;
+        auto name = seriesNames.find(key);
+        if (name == seriesNames.end())
+            name = seriesNames.emplace(key, dartlogSeriesName(tag, "", tagNames)).first;
+        return name->second;
+    }
+
+    // Verbose tags are skipped, but named as by the loaders, so the other series are named the same
+    void addTags(PJ::PlotDataMapRef &map, const std::vector<DartlogTag> &tags) {
+        for (const DartlogTag &tag : tags) {
+            const std::string &name = seriesName(tag);
+            if (tag.verbose) {
+                series[tag.index].clear();
+                continue;
+            }
+
+            series[tag.index] = name;
+            map.addNumeric(name);
+        }
+    }
+
+    /**
+     * @brief Adds the staged values, converted by DartlogStaging::convert()
+     */
+    void addValues(PJ::PlotDataMapRef &map, const DartlogStaging &staging) {
+        const std::vector<double> &times = staging.times();
+        for (uint32_t id : staging.keys()) {
+            auto name = series.find((uint16_t) id);
+            if (name == series.end() || name->second.empty())
+                continue;
+
+            PJ::PlotData &data = map.addNumeric(name->second)->second;
+            const DartlogStaging::Column &values = *staging.column(id);
+            for (size_t i = 0; i < values.values.size(); i++)
+                data.pushBack(PJ::PlotData::Point(times[values.timeIndices[i]], values.values[i]));
+        }
+    }
+
+private:
+    // Series name of every tag ID, empty for skipped verbose tags
+    std::map<uint16_t, std::string> series;
+    // Series name of every tag name and unit
+    std::map<std::string, std::string> seriesNames;
+    std::set<std::string> tagNames;
+};
@@ -0,0 +1,376 @@
+#include "datastream_dartlog_file.h"
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QMessageBox>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <memory>
+
+#include "dartlog_parser.h"
+
+DataStreamDARTLogFile::DataStreamDARTLogFile() : _overview_first(false), _running(false) {
+    _overview_first_action = new QAction("Load overview first", this);
+    _overview_first_action->setCheckable(true);
+    connect(_overview_first_action, &QAction::toggled, this, [this](bool checked) { _overview_first = checked; });
+    _actions.push_back(_overview_first_action);
+}
+
+DataStreamDARTLogFile::~DataStreamDARTLogFile() {
+    shutdown();
+}
+
+bool DataStreamDARTLogFile::start(QStringList *pre_selected_sources) {
+    if (_running)
+        return true;
+
+    QString filename = QFileDialog::getOpenFileName(nullptr, "DARTLog File (progressive)", QFileInfo(_filename).absolutePath(),
+                                                    "DARTLOG (*.dat *.gz *.lz4)");
+    if (filename.isEmpty())
+        return false;
+
+    // Check the header here, so a wrong file is reported right away
+    DartlogInput input;
+    DartlogParser parser(input);
+    if (!input.openHead(filename, DARTLOG_PROGRESSIVE_HEAD_SIZE) || !parser.readHeader()) {
+        QMessageBox::warning(nullptr, "DARTLog File (progressive)", "Not a DARTLOG file: header missing.");
+        return false;
+    }
+    if (parser.version() >= 3) {
+        QMessageBox::warning(nullptr, "DARTLog File (progressive)", "DARTLOG3 files can only be loaded as a whole.");
+        return false;
+    }
+    input.close();
+    _filename = filename;
+
+    // Series of the layout, loaded first
+    _priority.clear();
+    if (pre_selected_sources != nullptr) {
+        for (const QString &source : *pre_selected_sources)
+            _priority.insert(source.toStdString());
+    }
+
+    _series.clear();
+
+    _running = true;
+    _thread = std::thread(&DataStreamDARTLogFile::load, this);
+    return true;
+}
+
+void DataStreamDARTLogFile::shutdown() {
+    _running = false;
+    if (_thread.joinable())
+        _thread.join();
+}
+
+bool DataStreamDARTLogFile::isRunning() const {
+    return _running;
+}
+
+/**
+ * @brief Worker thread: decodes the log and publishes the values decoded so far in batches
+ *
+ * With series given by the layout, a first pass decodes only these and a second pass all others.
+ */
+void DataStreamDARTLogFile::load() {
+    // Sampled from the compressed file, before the whole log is decompressed
+    _sampled.clear();
+    if (_overview_first)
+        overview();
+
+    DartlogInput input;
+    if (input.open(_filename, nullptr)) {
+        if (_priority.empty())
+            decode(input, [](const std::string &) { return true; });
+        else {
+            decode(input, [this](const std::string &name) { return _priority.count(name) > 0; });
+
+            // Logs in memory are not decompressed again for the second pass
+            if (_running && (input.rewind() || input.open(_filename, nullptr)))
+                decode(input, [this](const std::string &name) { return _priority.count(name) == 0; });
+        }
+    }
+
+    // Fully loaded, the streamer stops and the data stays
+    _running = false;
+    emit closed();
+}
+
+/**
+ * @brief Publishes a coarse view of an indexed gzip log: one value of every tag from the start of evenly
+ * spaced blocks, each decompressed only as far as needed
+ *
+ * The tag table at every block is known from the blocks defining tags, which are decompressed as a whole.
+ * @return @c false if the log is not an indexed gzip log or could not be sampled
+ */
+bool DataStreamDARTLogFile::overview() {
+    QFile file(_filename);
+    if (!file.open(QFile::ReadOnly))
+        return false;
+    qint64 fileSize = file.size();
+    const char *data = (const char *) file.map(0, fileSize);
+
+    std::vector<DartlogGzipBlock> blocks;
+    if (data == nullptr || !DartlogGzipIndex::read(data, fileSize, blocks) || blocks.size() < 2)
+        return false;
+
+    QByteArray blockData;
+    DartlogInput blockInput;
+    DartlogParser parser(blockInput);
+
+    // Decompresses a block, or only its first maxSize bytes
+    auto inflate = [&](size_t b, qint64 maxSize) {
+        const char *compressed = data + blocks[b].compressedOffset;
+        if ((qint64) blocks[b].size <= maxSize) {
+            blockData.resize((int) blocks[b].size);
+            return QCompressor::gzipDecompress(compressed, blocks[b].compressedSize, blockData.data(), blockData.size());
+        }
+
+        blockData.resize((int) maxSize);
+        qint64 size = QCompressor::gzipDecompressHead(compressed, blocks[b].compressedSize, blockData.data(), maxSize);
+        blockData.resize((int) qMax<qint64>(size, 0));
+        return size >= 0;
+    };
+
+    if (!inflate(0, blocks[0].size))
+        return false;
+    blockInput.openBuffer(blockData.constData(), blockData.size());
+    if (!parser.readHeader() || parser.version() >= 3)
+        return false;
+    qint64 headerSize = blockInput.getPos();
+
+    using TagTable = std::map<uint16_t, DartlogTag>;
+    std::vector<std::shared_ptr<const DartlogParserState>> states(blocks.size());
+    std::vector<std::shared_ptr<const TagTable>> tables(blocks.size());
+    auto state = std::make_shared<const DartlogParserState>(parser.state());
+    auto table = std::make_shared<const TagTable>();
+
+    // Parser state as at the start of a block, see decode()
+    auto openBlock = [&](size_t b) {
+        int skip = (int) qMin<qint64>(qMax<qint64>(headerSize - (qint64) blocks[b].offset, 0), blockData.size());
+        blockInput.openBuffer(blockData.constData() + skip, blockData.size() - skip);
+
+        DartlogParserState blockState = *states[b];
+        blockState.lastID = blocks[b].lastID;
+        blockState.time = blocks[b].time;
+        blockState.hasTime = b > 0;
+        parser.setState(blockState);
+    };
+
+    for (size_t b = 0; b < blocks.size() && _running; b++) {
+        states[b] = state;
+        tables[b] = table;
+        if ((blocks[b].flags & DARTLOG_GZIP_FLAG_DEFINES_TAGS) == 0)
+            continue;
+
+        if (!inflate(b, blocks[b].size))
+            return false;
+        openBlock(b);
+
+        // Named in the order of definition, as in the full passes
+        auto blockTable = std::make_shared<TagTable>(*table);
+        DartlogParser::Record record;
+        while ((record = parser.next()) == DartlogParser::Value || record == DartlogParser::TagDefinition) {
+            if (record != DartlogParser::TagDefinition)
+                continue;
+
+            const DartlogTag &tag = parser.tag();
+            (*blockTable)[tag.index] = tag;
+            _series.seriesName(tag);
+        }
+
+        state = std::make_shared<const DartlogParserState>(parser.state());
+        table = blockTable;
+    }
+
+    // The first value of every ID within the window, until every tag has one
+    std::map<std::string, std::vector<PlotData::Point>> points;
+    std::vector<uint64_t> sampled(blocks.size(), 0);
+    std::vector<uint32_t> seen(UINT16_MAX + 1, 0);
+    size_t count = std::min<size_t>(DARTLOG_OVERVIEW_CHECKPOINTS, blocks.size());
+
+    for (size_t i = 0; i < count && _running; i++) {
+        size_t b = i * blocks.size() / count;
+        if (!inflate(b, DARTLOG_OVERVIEW_WINDOW_SIZE + (b == 0 ? headerSize : 0)))
+            continue;
+        openBlock(b);
+
+        TagTable tags = *tables[b];
+        size_t pending = std::count_if(tags.begin(), tags.end(), [](const TagTable::value_type &tag) { return !tag.second.verbose; });
+        uint64_t values = 0;
+
+        DartlogParser::Record record;
+        while (pending > 0 && ((record = parser.next()) == DartlogParser::Value || record == DartlogParser::TagDefinition)) {
+            if (record == DartlogParser::TagDefinition) {
+                tags[parser.tag().index] = parser.tag();
+                continue;
+            }
+
+            values++;
+            uint16_t id = parser.valueID();
+            if (seen[id] == i + 1)
+                continue;
+            seen[id] = (uint32_t) i + 1;
+
+            auto tag = tags.find(id);
+            if (tag == tags.end() || tag->second.verbose)
+                continue;
+            points[_series.seriesName(tag->second)].emplace_back(parser.time(), parser.value());
+            pending--;
+        }
+        sampled[b] = values;
+    }
+
+    if (!_running)
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex());
+        for (const auto &series : points) {
+            PlotData &plot = dataMap().addNumeric(series.first)->second;
+            for (const PlotData::Point &point : series.second)
+                plot.pushBack(point);
+        }
+    }
+    emit dataReceived();
+
+    _sampled.swap(sampled);
+    return true;
+}
+
+/**
+ * @brief Decodes one pass over the log, publishing the values of the wanted series in batches
+ * @param wanted Checks if the values of a series are added in this pass
+ */
+void DataStreamDARTLogFile::decode(DartlogInput &input, const std::function<bool(const std::string &)> &wanted) {
+    DartlogParser headerParser(input);
+    if (!headerParser.readHeader())
+        return;
+
+    // After an overview the blocks are decoded from their index state as it sampled them, so the values
+    // it published are known and left out
+    const std::vector<DartlogGzipBlock> &blocks = input.blocks();
+    bool byBlock = !_sampled.empty() && _sampled.size() == blocks.size();
+    qint64 headerSize = input.getPos();
+    DartlogInput blockInput;
+    DartlogParser blockParser(blockInput);
+    DartlogParser &parser = byBlock ? blockParser : headerParser;
+
+    size_t block = 0;
+    // Values decoded in the current block, and the block (plus one) the last value of an ID was sampled in
+    uint64_t blockValues = 0;
+    std::vector<uint32_t> sampled(byBlock ? UINT16_MAX + 1 : 0, 0);
+
+    auto openBlock = [&]() {
+        qint64 start = qMax((qint64) blocks[block].offset, headerSize);
+        qint64 size = (qint64) (blocks[block].offset + blocks[block].size) - start;
+        const char *data = input.mapRange(start, size);
+        blockInput.openBuffer(data, data != nullptr ? size : 0);
+
+        DartlogParserState state = blockParser.state();
+        state.lastID = blocks[block].lastID;
+        state.time = blocks[block].time;
+        state.hasTime = block > 0;
+        blockParser.setState(state);
+        blockValues = 0;
+    };
+
+    auto position = [&]() {
+        return byBlock ? (qint64) blocks[block].offset + blockInput.getPos() : input.getPos();
+    };
+
+    if (byBlock) {
+        blockParser.setState(headerParser.state());
+        openBlock();
+    }
+
+    DartlogStaging staging;
+    std::vector<DartlogTag> newTags;
+    std::vector<bool> skipped(UINT16_MAX + 1, false);
+
+    auto published = std::chrono::steady_clock::now();
+    qint64 publishedPos = 0;
+
+    // One lock of the data map per batch, the values are converted before
+    auto publish = [&]() {
+        staging.convert();
+        {
+            std::lock_guard<std::mutex> lock(mutex());
+            _series.addTags(dataMap(), newTags);
+            _series.addValues(dataMap(), staging);
+        }
+        staging.clear();
+        newTags.clear();
+
+        published = std::chrono::steady_clock::now();
+        publishedPos = position();
+        emit dataReceived();
+    };
+
+    dartlogDispatchVersion(parser.version(), [&](auto version) {
+        constexpr int Version = decltype(version)::value;
+
+        uint64_t counter = 0;
+
+        while (_running) {
+            if (++counter % DARTLOG_PROGRESSIVE_CHECK_RECORDS == 0 &&
+                (std::chrono::steady_clock::now() - published > std::chrono::milliseconds(DARTLOG_PROGRESSIVE_INTERVAL_MS) ||
+                 position() - publishedPos >= DARTLOG_PROGRESSIVE_BATCH_SIZE))
+                publish();
+
+            DartlogParser::Record record = parser.next<Version>();
+            if (record == DartlogParser::End && byBlock && block + 1 < blocks.size()) {
+                block++;
+                openBlock();
+                continue;
+            }
+            if (record == DartlogParser::End || record == DartlogParser::Error)
+                break;
+
+            if (record == DartlogParser::TagDefinition) {
+                // The values of a redefined tag staged so far belong to its old series
+                const DartlogTag &tag = parser.tag();
+                if (staging.column(tag.index) != nullptr)
+                    publish();
+
+                // Verbose tags are named as well, as by the loader
+                const std::string &name = _series.seriesName(tag);
+                skipped[tag.index] = tag.verbose || !wanted(name);
+                if (!skipped[tag.index])
+                    newTags.push_back(tag);
+                continue;
+            }
+
+            // The first value of every ID at the start of a sampled block is already published
+            uint16_t id = parser.valueID();
+            if (byBlock && blockValues++ < _sampled[block] && sampled[id] != block + 1) {
+                sampled[id] = (uint32_t) block + 1;
+                continue;
+            }
+
+            if (!skipped[id])
+                staging.add(id, parser.valueType(), parser.rawValue(), parser.time());
+        }
+    });
+    publish();
+}
+
+bool DataStreamDARTLogFile::xmlSaveState(QDomDocument &, QDomElement &parent_element) const {
+    parent_element.setAttribute("filename", _filename);
+    parent_element.setAttribute("overview_first", _overview_first ? "true" : "false");
+    return true;
+}
+
+bool DataStreamDARTLogFile::xmlLoadState(const QDomElement &parent_element) {
+    QString filename = parent_element.attribute("filename");
+    if (!filename.isEmpty())
+        _filename = filename;
+
+    _overview_first = parent_element.attribute("overview_first") == "true";
+    _overview_first_action->setChecked(_overview_first);
+    return true;
+}
+
+const std::vector<QAction *> &DataStreamDARTLogFile::availableActions() {
+    return _actions;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <QAction>
+#include <QObject>
+#include <QtPlugin>
+#include <QStringList>
+#include <atomic>
+#include <functional>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include "PlotJuggler/datastreamer_base.h"
+#include "dartlog_input.h"
+#include "dartlog_stream_series.h"
+
+using namespace PJ;
+
+// Longest time decoded values are held back before they are published to the plots
+#define DARTLOG_PROGRESSIVE_INTERVAL_MS 500
+// Bytes of the log decoded at most before the values are published
+#define DARTLOG_PROGRESSIVE_BATCH_SIZE (64 * 1024 * 1024)
+// Records decoded between checks for a batch to publish
+#define DARTLOG_PROGRESSIVE_CHECK_RECORDS (32 * 1024)
+// Decompressed bytes read to check the header before loading
+#define DARTLOG_PROGRESSIVE_HEAD_SIZE (64 * 1024)
+// Blocks of an indexed gzip log sampled at most for the overview
+#define DARTLOG_OVERVIEW_CHECKPOINTS 128
+// Decompressed bytes at the start of a sampled block searched for a value of every tag
+#define DARTLOG_OVERVIEW_WINDOW_SIZE (64 * 1024)
+
+/**
+ * @brief Loads a DARTLOG or DARTLOG2 file progressively: the records are decoded on a worker thread and
+ * published to the plots in batches while the rest is still loading, so the start of a large log can be
+ * inspected right away
+ *
+ * Batches are published every DARTLOG_PROGRESSIVE_INTERVAL_MS or DARTLOG_PROGRESSIVE_BATCH_SIZE bytes, with
+ * one lock of the data map each. As for every streamer, the buffer size of PlotJuggler limits the time
+ * range kept, set it to at least the length of the log.
+ *
+ * Started from a layout, the series of the layout (the sources selected by PlotJuggler) are decoded and
+ * published first, the other series follow in a second pass over the log.
+ *
+ * With "Load overview first", an indexed gzip log (see DartlogGzipIndex) is first sampled at up to
+ * DARTLOG_OVERVIEW_CHECKPOINTS evenly spaced blocks: one value of every tag from the start of each block
+ * gives a coarse view of the whole log before the full resolution is loaded. The full passes then decode
+ * the log block by block and leave out the sampled values.
+ */
+class DataStreamDARTLogFile : public DataStreamer {
+    Q_OBJECT
+    Q_PLUGIN_METADATA(IID "facontidavide.PlotJuggler3.DataStreamer")
+    Q_INTERFACES(PJ::DataStreamer)
+
+public:
+    DataStreamDARTLogFile();
+
+    ~DataStreamDARTLogFile() override;
+
+    bool start(QStringList *pre_selected_sources) override;
+
+    void shutdown() override;
+
+    bool isRunning() const override;
+
+    virtual const char *name() const override {
+        return "DARTLog File (progressive)";
+    }
+
+    bool xmlSaveState(QDomDocument &doc, QDomElement &parent_element) const override;
+
+    bool xmlLoadState(const QDomElement &parent_element) override;
+
+    const std::vector<QAction *> &availableActions() override;
+
+private:
+    QString _filename;
+    std::atomic<bool> _overview_first;
+    QAction *_overview_first_action;
+    std::vector<QAction *> _actions;
+    std::atomic<bool> _running;
+    std::thread _thread;
+
+    // Series loaded before all others
+    std::set<std::string> _priority;
+    DartlogStreamSeries _series;
+    // Per block of an indexed gzip log, the values at its start the overview was sampled from (0 if none)
+    std::vector<uint64_t> _sampled;
+
+    void load();
+    bool overview();
+    void decode(DartlogInput &input, const std::function<bool(const std::string &)> &wanted);
+};
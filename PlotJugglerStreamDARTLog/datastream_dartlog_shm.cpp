@@ -0,0 +1,103 @@
+#include "datastream_dartlog_shm.h"
+#include <QInputDialog>
+#include <QLineEdit>
+#include <QMessageBox>
+#include <chrono>
+#include <memory>
+
+DataStreamDARTLogShm::DataStreamDARTLogShm() : _shm_name(DARTLOG_SHM_DEFAULT_NAME), _running(false) {
+}
+
+DataStreamDARTLogShm::~DataStreamDARTLogShm() {
+    shutdown();
+}
+
+bool DataStreamDARTLogShm::start(QStringList *) {
+    if (_running)
+        return true;
+
+    bool ok;
+    QString name = QInputDialog::getText(nullptr, "DARTLog Shared Memory", "Name of the shared memory ring:",
+                                         QLineEdit::Normal, _shm_name, &ok);
+    if (!ok || name.isEmpty())
+        return false;
+    if (!name.startsWith("/"))
+        name = "/" + name;
+    _shm_name = name;
+
+    // Attach once here, so a wrong name is reported right away
+    DartlogShmRing ring;
+    if (!ring.attach(_shm_name)) {
+        QMessageBox::warning(nullptr, "DARTLog Shared Memory", ring.errorString());
+        return false;
+    }
+    ring.close();
+
+    _series.clear();
+
+    _running = true;
+    _thread = std::thread(&DataStreamDARTLogShm::receive, this);
+    return true;
+}
+
+void DataStreamDARTLogShm::shutdown() {
+    _running = false;
+    if (_thread.joinable())
+        _thread.join();
+}
+
+bool DataStreamDARTLogShm::isRunning() const {
+    return _running;
+}
+
+/**
+ * @brief Reader thread: decodes every batch published to the ring and adds it to the plots at once
+ */
+void DataStreamDARTLogShm::receive() {
+    DartlogShmRing ring;
+    std::unique_ptr<DartlogShmReader> reader;
+    DartlogStaging staging;
+    std::vector<DartlogTag> newTags;
+    auto lastData = std::chrono::steady_clock::now();
+
+    while (_running) {
+        // Attach to the ring, again if a restarted producer replaced it
+        auto idle = std::chrono::steady_clock::now() - lastData;
+        if (!ring.isOpen() || (idle > std::chrono::milliseconds(DARTLOG_SHM_REATTACH_MS) && ring.isReplaced(_shm_name))) {
+            if (!ring.attach(_shm_name)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(DARTLOG_SHM_REATTACH_MS));
+                continue;
+            }
+            reader.reset(new DartlogShmReader(ring));
+            lastData = std::chrono::steady_clock::now();
+        }
+
+        newTags.clear();
+        if (!reader->poll(staging, newTags)) {
+            std::this_thread::sleep_for(std::chrono::microseconds(DARTLOG_SHM_POLL_US));
+            continue;
+        }
+        lastData = std::chrono::steady_clock::now();
+
+        staging.convert();
+        {
+            std::lock_guard<std::mutex> lock(mutex());
+            _series.addTags(dataMap(), newTags);
+            _series.addValues(dataMap(), staging);
+        }
+        staging.clear();
+        emit dataReceived();
+    }
+}
+
+bool DataStreamDARTLogShm::xmlSaveState(QDomDocument &, QDomElement &parent_element) const {
+    parent_element.setAttribute("shm_name", _shm_name);
+    return true;
+}
+
+bool DataStreamDARTLogShm::xmlLoadState(const QDomElement &parent_element) {
+    QString name = parent_element.attribute("shm_name");
+    if (!name.isEmpty())
+        _shm_name = name;
+    return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QObject>
+#include <QtPlugin>
+#include <QStringList>
+#include <atomic>
+#include <thread>
+#include "PlotJuggler/datastreamer_base.h"
+#include "dartlog_shm.h"
+#include "dartlog_stream_series.h"
+
+using namespace PJ;
+
+// Idle time of the reader before it checks if the producer replaced the ring
+#define DARTLOG_SHM_REATTACH_MS 500
+
+/**
+ * @brief Streams the records of a logger process from a shared memory ring, see dartlog_shm.h
+ */
+class DataStreamDARTLogShm : public DataStreamer {
+    Q_OBJECT
+    Q_PLUGIN_METADATA(IID "facontidavide.PlotJuggler3.DataStreamer")
+    Q_INTERFACES(PJ::DataStreamer)
+
+public:
+    DataStreamDARTLogShm();
+
+    ~DataStreamDARTLogShm() override;
+
+    bool start(QStringList *pre_selected_sources) override;
+
+    void shutdown() override;
+
+    bool isRunning() const override;
+
+    virtual const char *name() const override {
+        return "DARTLog Shared Memory";
+    }
+
+    bool xmlSaveState(QDomDocument &doc, QDomElement &parent_element) const override;
+
+    bool xmlLoadState(const QDomElement &parent_element) override;
+
+private:
+    QString _shm_name;
+    std::atomic<bool> _running;
+    std::thread _thread;
+
+    DartlogStreamSeries _series;
+
+    void receive();
+};
@@ -0,0 +1,29 @@
+#include <QString>
+#include <cstdio>
+#include <cstring>
+
+#include "dartlog3.h"
+
+int main(int argc, char *argv[]) {
+    bool useEncodings = true;
+    if (argc == 4 && strcmp(argv[1], "--no-encoding") == 0) {
+        useEncodings = false;
+        argv++;
+        argc--;
+    }
+
+    if (argc != 3) {
+        fprintf(stderr, "Usage: dartlog_convert [--no-encoding] <input> <output>\n");
+        fprintf(stderr, "Converts a DARTLOG or DARTLOG2 log (.dat, .gz or .lz4) into a DARTLOG3 container.\n");
+        fprintf(stderr, "  --no-encoding  store all blocks zlib compressed instead of using the time series encodings\n");
+        return 2;
+    }
+
+    QString error;
+    bool ok = convertToDartlog3(QString::fromLocal8Bit(argv[1]), QString::fromLocal8Bit(argv[2]), error, useEncodings);
+
+    if (!error.isEmpty())
+        fprintf(stderr, "%s\n", error.toLocal8Bit().constData());
+
+    return ok ? 0 : 1;
+}
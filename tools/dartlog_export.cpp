@@ -0,0 +1,69 @@
+#include <QString>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "dartlog_writer.h"
+
+static void printUsage() {
+    fprintf(stderr, "Usage: dartlog_export [options] <input> <output>\n");
+    fprintf(stderr, "Exports a subset of a DARTLOG or DARTLOG2 log (.dat, .gz or .lz4) as DARTLOG2.\n");
+    fprintf(stderr, "The output is compressed on all cores if its name ends with .gz.\n");
+    fprintf(stderr, "  --tags <a,b,c*>  tag names to export, a trailing '*' matches any suffix (default: all)\n");
+    fprintf(stderr, "  --start <time>   first time to export\n");
+    fprintf(stderr, "  --end <time>     last time to export\n");
+    fprintf(stderr, "  --level <0-9>    compression level\n");
+}
+
+static std::vector<std::string> splitList(const char *list) {
+    std::vector<std::string> items;
+    std::string item;
+    for (const char *c = list;; c++) {
+        if (*c == ',' || *c == '\0') {
+            if (!item.empty())
+                items.push_back(item);
+            item.clear();
+            if (*c == '\0')
+                break;
+        }
+        else
+            item += *c;
+    }
+    return items;
+}
+
+int main(int argc, char *argv[]) {
+    DartlogExportOptions options;
+    int arg = 1;
+
+    for (; arg + 1 < argc && strncmp(argv[arg], "--", 2) == 0; arg += 2) {
+        if (strcmp(argv[arg], "--tags") == 0)
+            options.tags = splitList(argv[arg + 1]);
+        else if (strcmp(argv[arg], "--start") == 0)
+            options.timeStart = atof(argv[arg + 1]);
+        else if (strcmp(argv[arg], "--end") == 0)
+            options.timeEnd = atof(argv[arg + 1]);
+        else if (strcmp(argv[arg], "--level") == 0)
+            options.level = atoi(argv[arg + 1]);
+        else {
+            printUsage();
+            return 2;
+        }
+    }
+
+    if (argc - arg != 2) {
+        printUsage();
+        return 2;
+    }
+
+    QString outputFilename = QString::fromLocal8Bit(argv[arg + 1]);
+    options.compress = outputFilename.endsWith(".gz", Qt::CaseInsensitive);
+
+    QString error;
+    bool ok = exportDartlogSubset(QString::fromLocal8Bit(argv[arg]), outputFilename, options, error);
+
+    if (!error.isEmpty())
+        fprintf(stderr, "%s\n", error.toLocal8Bit().constData());
+
+    return ok ? 0 : 1;
+}
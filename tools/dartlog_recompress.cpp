@@ -0,0 +1,30 @@
+#include <QString>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "dartlog_gzip_index.h"
+
+int main(int argc, char *argv[]) {
+    int level = -1;
+    if (argc == 5 && strcmp(argv[1], "--level") == 0) {
+        level = atoi(argv[2]);
+        argv += 2;
+        argc -= 2;
+    }
+
+    if (argc != 3) {
+        fprintf(stderr, "Usage: dartlog_recompress [--level <0-9>] <input> <output>\n");
+        fprintf(stderr, "Rewrites a DARTLOG or DARTLOG2 log (.dat, .gz or .lz4) as indexed gzip, which the plugin\n");
+        fprintf(stderr, "decompresses and decodes on all cores. The output is still a valid gzip file of the log.\n");
+        return 2;
+    }
+
+    QString error;
+    bool ok = recompressDartlogGzip(QString::fromLocal8Bit(argv[1]), QString::fromLocal8Bit(argv[2]), error, level);
+
+    if (!error.isEmpty())
+        fprintf(stderr, "%s\n", error.toLocal8Bit().constData());
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,139 @@
+#include <QString>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "dartlog_input.h"
+#include "dartlog_parser.h"
+#include "dartlog_shm.h"
+
+// Stream bytes published at once when replaying as fast as possible
+#define DARTLOG_SHM_REPLAY_BATCH (64 * 1024)
+
+int main(int argc, char *argv[]) {
+    QString name = DARTLOG_SHM_DEFAULT_NAME;
+    qint64 capacity = DARTLOG_SHM_DEFAULT_CAPACITY;
+    double speed = 1;
+    while (argc == 4 || argc == 6 || argc == 8) {
+        if (strcmp(argv[1], "--name") == 0)
+            name = QString::fromLocal8Bit(argv[2]);
+        else if (strcmp(argv[1], "--capacity") == 0)
+            capacity = (qint64) atoi(argv[2]) * 1024 * 1024;
+        else if (strcmp(argv[1], "--speed") == 0)
+            speed = atof(argv[2]);
+        else
+            break;
+        argv += 2;
+        argc -= 2;
+    }
+
+    if (argc != 2 || capacity <= 0 || speed < 0) {
+        fprintf(stderr, "Usage: dartlog_shm_replay [--name <shm>] [--capacity <MB>] [--speed <factor>] <log>\n");
+        fprintf(stderr, "Replays a DARTLOG or DARTLOG2 log (.dat, .gz or .lz4) into a shared memory ring (default %s),\n",
+                DARTLOG_SHM_DEFAULT_NAME);
+        fprintf(stderr, "paced by its time scaled by the speed factor, 0 for as fast as possible. For testing the\n");
+        fprintf(stderr, "DARTLog Shared Memory streamer without a logger.\n");
+        return 2;
+    }
+
+    DartlogInput input;
+    if (!input.open(QString::fromLocal8Bit(argv[1]), nullptr)) {
+        fprintf(stderr, "%s\n", input.errorString().toLocal8Bit().constData());
+        return 1;
+    }
+
+    if (!input.hasRandomAccess()) {
+        fprintf(stderr, "Logs with linked LZ4 blocks can not be replayed\n");
+        return 1;
+    }
+
+    DartlogParser parser(input);
+    if (!parser.readHeader() || parser.version() >= 3) {
+        fprintf(stderr, "Not a DARTLOG or DARTLOG2 file: header missing.\n");
+        return 1;
+    }
+
+    DartlogShmRing ring;
+    if (!ring.create(name, capacity)) {
+        fprintf(stderr, "%s\n", ring.errorString().toLocal8Bit().constData());
+        return 1;
+    }
+
+    // The header string is kept with the definitions, so readers can attach at any time
+    qint64 pos = input.getPos();
+    qint64 publishedPos = pos;
+    QByteArray copy;
+    const char *data = input.mapRange(0, pos, copy);
+    bool ok = data != nullptr && ring.write(data, pos, true);
+    ring.publish(0, 0, false);
+
+    // Parser state at pos, published with it
+    uint16_t timeID = 0;
+    uint16_t lastID = 0;
+    float time = 0;
+    bool hasTime = false;
+
+    auto start = std::chrono::steady_clock::now();
+    auto paceStart = start;
+    float paceTime = 0;
+    bool paced = false;
+    qint64 records = 0;
+
+    while (ok) {
+        DartlogParser::Record record = parser.next();
+
+        if (record == DartlogParser::End)
+            break;
+
+        if (record == DartlogParser::Error) {
+            fprintf(stderr, "%s: replayed up to the error\n", parser.errorString().toLocal8Bit().constData());
+            break;
+        }
+
+        bool definition = record == DartlogParser::TagDefinition;
+        if (definition && parser.tag().name == "time")
+            timeID = parser.tag().index;
+
+        // Publish everything before a new time once it is due
+        if (!definition && parser.valueID() == timeID && timeID != 0 && speed > 0) {
+            ring.publish(lastID, time, hasTime);
+            publishedPos = pos;
+
+            float newTime = (float) parser.time();
+            if (!paced || newTime < paceTime) {
+                // Start pacing, again after a time reset
+                paceStart = std::chrono::steady_clock::now();
+                paceTime = newTime;
+                paced = true;
+            }
+            std::this_thread::sleep_until(paceStart + std::chrono::duration<double>((newTime - paceTime) / speed));
+        }
+
+        qint64 end = input.getPos();
+        data = input.mapRange(pos, end - pos, copy);
+        ok = data != nullptr && ring.write(data, end - pos, definition);
+        pos = end;
+        records++;
+
+        lastID = definition ? 0 : parser.valueID();
+        time = (float) parser.time();
+        hasTime = hasTime || (!definition && parser.valueID() == timeID && timeID != 0);
+
+        if (pos - publishedPos >= DARTLOG_SHM_REPLAY_BATCH) {
+            ring.publish(lastID, time, hasTime);
+            publishedPos = pos;
+        }
+    }
+
+    ring.publish(lastID, time, hasTime);
+    ring.finish();
+
+    if (!ok)
+        fprintf(stderr, "%s\n", ring.errorString().toLocal8Bit().constData());
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("Replayed %lld records (%lld bytes) in %.3f s\n", (long long) records, (long long) pos, seconds);
+    return ok ? 0 : 1;
+}